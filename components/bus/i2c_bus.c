@@ -28,13 +28,17 @@
 #define I2C_BUS_MS_TO_WAIT CONFIG_I2C_MS_TO_WAIT
 #define I2C_BUS_TICKS_TO_WAIT (I2C_BUS_MS_TO_WAIT/portTICK_RATE_MS)
 #define I2C_BUS_MUTEX_TICKS_TO_WAIT (I2C_BUS_MS_TO_WAIT/portTICK_RATE_MS)
+/* A register read is two transactions, a restart between the address and the data */
+#define I2C_BUS_CMD_LINK_SIZE I2C_LINK_RECOMMENDED_SIZE(2)
 
 typedef struct {
     i2c_port_t i2c_port;    /*!<I2C port number */
     bool is_init;   /*if bus is initialized*/
     i2c_config_t conf_active;    /*!<I2C active configuration */
     SemaphoreHandle_t mutex;    /* mutex to achive thread-safe*/
+    StaticSemaphore_t mutex_buf;    /* storage of the mutex */
     int32_t ref_counter;    /*reference count*/
+    uint8_t cmd_link_buf[I2C_BUS_CMD_LINK_SIZE];    /* command link of the transfer in progress, used under the mutex */
 } i2c_bus_t;
 
 typedef struct {
@@ -96,7 +100,7 @@ i2c_bus_handle_t i2c_bus_create(i2c_port_t port, const i2c_config_t *conf)
             return (i2c_bus_handle_t)&s_i2c_bus[port];
         }
     } else {
-        s_i2c_bus[port].mutex = xSemaphoreCreateMutex();
+        s_i2c_bus[port].mutex = xSemaphoreCreateMutexStatic(&s_i2c_bus[port].mutex_buf);
         I2C_BUS_CHECK(s_i2c_bus[port].mutex != NULL, "i2c_bus xSemaphoreCreateMutex failed", NULL);
         s_i2c_bus[port].ref_counter = 0;
     }
@@ -136,7 +140,7 @@ uint8_t i2c_bus_scan(i2c_bus_handle_t bus_handle, uint8_t *buf, uint8_t num)
     uint8_t device_count = 0;
     I2C_BUS_MUTEX_TAKE_MAX_DELAY(i2c_bus->mutex, 0);
     for (uint8_t dev_address = 1; dev_address < 127; dev_address++) {
-        i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+        i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(i2c_bus->cmd_link_buf, sizeof(i2c_bus->cmd_link_buf));
         i2c_master_start(cmd);
         i2c_master_write_byte(cmd, (dev_address << 1) | I2C_MASTER_WRITE, I2C_ACK_CHECK_EN);
         i2c_master_stop(cmd);
@@ -150,7 +154,7 @@ uint8_t i2c_bus_scan(i2c_bus_handle_t bus_handle, uint8_t *buf, uint8_t num)
             device_count++;
         }
 
-        i2c_cmd_link_delete(cmd);
+        i2c_cmd_link_delete_static(cmd);
     }
     I2C_BUS_MUTEX_GIVE(i2c_bus->mutex, 0);
     return device_count;
@@ -340,7 +344,7 @@ static esp_err_t i2c_bus_read_reg8(i2c_bus_device_handle_t dev_handle, uint8_t m
     i2c_bus_device_t *i2c_device = (i2c_bus_device_t *)dev_handle;
     I2C_BUS_INIT_CHECK(i2c_device->i2c_bus->is_init, ESP_ERR_INVALID_STATE);
     I2C_BUS_MUTEX_TAKE(i2c_device->i2c_bus->mutex, ESP_ERR_TIMEOUT);
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(i2c_device->i2c_bus->cmd_link_buf, sizeof(i2c_device->i2c_bus->cmd_link_buf));
 
     if (mem_address != NULL_I2C_MEM_ADDR) {
         i2c_master_start(cmd);
@@ -353,7 +357,7 @@ static esp_err_t i2c_bus_read_reg8(i2c_bus_device_handle_t dev_handle, uint8_t m
     i2c_master_read(cmd, data, data_len, I2C_MASTER_LAST_NACK);
     i2c_master_stop(cmd);
     esp_err_t ret = i2c_master_cmd_begin_with_conf(i2c_device->i2c_bus->i2c_port, cmd, I2C_BUS_TICKS_TO_WAIT, &i2c_device->conf);
-    i2c_cmd_link_delete(cmd);
+    i2c_cmd_link_delete_static(cmd);
     I2C_BUS_MUTEX_GIVE(i2c_device->i2c_bus->mutex, ESP_FAIL);
     return ret;
 }
@@ -368,7 +372,7 @@ esp_err_t i2c_bus_read_reg16(i2c_bus_device_handle_t dev_handle, uint16_t mem_ad
     memAddress8[0] = (uint8_t)((mem_address >> 8) & 0x00FF);
     memAddress8[1] = (uint8_t)(mem_address & 0x00FF);
     I2C_BUS_MUTEX_TAKE(i2c_device->i2c_bus->mutex, ESP_ERR_TIMEOUT);
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(i2c_device->i2c_bus->cmd_link_buf, sizeof(i2c_device->i2c_bus->cmd_link_buf));
 
     if (mem_address != NULL_I2C_MEM_ADDR) {
         i2c_master_start(cmd);
@@ -381,7 +385,7 @@ esp_err_t i2c_bus_read_reg16(i2c_bus_device_handle_t dev_handle, uint16_t mem_ad
     i2c_master_read(cmd, data, data_len, I2C_MASTER_LAST_NACK);
     i2c_master_stop(cmd);
     esp_err_t ret = i2c_master_cmd_begin_with_conf(i2c_device->i2c_bus->i2c_port, cmd, I2C_BUS_TICKS_TO_WAIT, &i2c_device->conf);
-    i2c_cmd_link_delete(cmd);
+    i2c_cmd_link_delete_static(cmd);
     I2C_BUS_MUTEX_GIVE(i2c_device->i2c_bus->mutex, ESP_FAIL);
     return ret;
 }
@@ -393,7 +397,7 @@ static esp_err_t i2c_bus_write_reg8(i2c_bus_device_handle_t dev_handle, uint8_t
     i2c_bus_device_t *i2c_device = (i2c_bus_device_t *)dev_handle;
     I2C_BUS_INIT_CHECK(i2c_device->i2c_bus->is_init, ESP_ERR_INVALID_STATE);
     I2C_BUS_MUTEX_TAKE(i2c_device->i2c_bus->mutex, ESP_ERR_TIMEOUT);
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(i2c_device->i2c_bus->cmd_link_buf, sizeof(i2c_device->i2c_bus->cmd_link_buf));
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, (i2c_device->dev_addr << 1) | I2C_MASTER_WRITE, I2C_ACK_CHECK_EN);
 
@@ -404,7 +408,7 @@ static esp_err_t i2c_bus_write_reg8(i2c_bus_device_handle_t dev_handle, uint8_t
     i2c_master_write(cmd, (uint8_t *)data, data_len, I2C_ACK_CHECK_EN);
     i2c_master_stop(cmd);
     esp_err_t ret = i2c_master_cmd_begin_with_conf(i2c_device->i2c_bus->i2c_port, cmd, I2C_BUS_TICKS_TO_WAIT, &i2c_device->conf);
-    i2c_cmd_link_delete(cmd);
+    i2c_cmd_link_delete_static(cmd);
     I2C_BUS_MUTEX_GIVE(i2c_device->i2c_bus->mutex, ESP_FAIL);
     return ret;
 }
@@ -419,7 +423,7 @@ esp_err_t i2c_bus_write_reg16(i2c_bus_device_handle_t dev_handle, uint16_t mem_a
     memAddress8[0] = (uint8_t)((mem_address >> 8) & 0x00FF);
     memAddress8[1] = (uint8_t)(mem_address & 0x00FF);
     I2C_BUS_MUTEX_TAKE(i2c_device->i2c_bus->mutex, ESP_ERR_TIMEOUT);
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(i2c_device->i2c_bus->cmd_link_buf, sizeof(i2c_device->i2c_bus->cmd_link_buf));
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, (i2c_device->dev_addr << 1) | I2C_MASTER_WRITE, I2C_ACK_CHECK_EN);
 
@@ -430,7 +434,7 @@ esp_err_t i2c_bus_write_reg16(i2c_bus_device_handle_t dev_handle, uint16_t mem_a
     i2c_master_write(cmd, (uint8_t *)data, data_len, I2C_ACK_CHECK_EN);
     i2c_master_stop(cmd);
     esp_err_t ret = i2c_master_cmd_begin_with_conf(i2c_device->i2c_bus->i2c_port, cmd, I2C_BUS_TICKS_TO_WAIT, &i2c_device->conf);
-    i2c_cmd_link_delete(cmd);
+    i2c_cmd_link_delete_static(cmd);
     I2C_BUS_MUTEX_GIVE(i2c_device->i2c_bus->mutex, ESP_FAIL);
     return ret;
 }
@@ -32,15 +32,24 @@
 #define ES8156_ADDR             0x08
 
 static i2c_bus_device_handle_t i2c_handle;
+static uint32_t error_count;
+
+static esp_err_t es8156_check(esp_err_t ret)
+{
+    if (ret != ESP_OK) {
+        error_count++;
+    }
+    return ret;
+}
 
 static esp_err_t es8156_write_reg(uint8_t reg_addr, uint8_t data)
 {
-    return i2c_bus_write_byte(i2c_handle, reg_addr, data);
+    return es8156_check(i2c_bus_write_byte(i2c_handle, reg_addr, data));
 }
 
 static esp_err_t es8156_read_reg(uint8_t reg_addr, uint8_t *data)
 {
-    return i2c_bus_read_byte(i2c_handle, reg_addr, data);
+    return es8156_check(i2c_bus_read_byte(i2c_handle, reg_addr, data));
 }
 
 esp_err_t es8156_standby(void)
@@ -103,8 +112,8 @@ esp_err_t es8156_codec_init(i2c_bus_handle_t bus)
 esp_err_t es8156_codec_set_voice_mute(int channel, bool enable)
 {
     // master channel
-    if(channel == 0) return i2c_bus_write_bits(i2c_handle, ES8156_DAC_MUTE_REG13, 1, 2, enable ? 0b11: 0);
-    return i2c_bus_write_bit(i2c_handle, ES8156_DAC_MUTE_REG13, channel, enable);
+    if(channel == 0) return es8156_check(i2c_bus_write_bits(i2c_handle, ES8156_DAC_MUTE_REG13, 1, 2, enable ? 0b11: 0));
+    return es8156_check(i2c_bus_write_bit(i2c_handle, ES8156_DAC_MUTE_REG13, channel, enable));
 }
 
 esp_err_t es8156_codec_get_voice_mute(int channel, bool *enable)
@@ -138,4 +147,14 @@ esp_err_t es8156_codec_set_voice_volume(uint8_t volume)
 esp_err_t es8156_codec_get_voice_volume(uint8_t *volume)
 {
     return es8156_read_reg(ES8156_VOLUME_CONTROL_REG14, volume);
-}
\ No newline at end of file
+}
+
+esp_err_t es8156_codec_read_reg(uint8_t reg_addr, uint8_t *data)
+{
+    return es8156_read_reg(reg_addr, data);
+}
+
+uint32_t es8156_get_error_count(void)
+{
+    return error_count;
+}
@@ -141,6 +141,25 @@ esp_err_t es8156_standby(void);
 
 esp_err_t es8156_resume(void);
 
+/**
+ * @brief Read a raw register, for diagnostics
+ *
+ * @param reg_addr: register address
+ * @param[out] *data: register value
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t es8156_codec_read_reg(uint8_t reg_addr, uint8_t *data);
+
+/**
+ * @brief Get the number of failed I2C transactions since boot
+ *
+ * @return error count
+ */
+uint32_t es8156_get_error_count(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -41,6 +41,25 @@
 
 #include "device/dcd.h"
 
+#ifndef CFG_TUD_DCD_ISR_PROBE
+#define CFG_TUD_DCD_ISR_PROBE 0
+#endif
+
+#if CFG_TUD_DCD_ISR_PROBE
+#include "esp_cpu.h"
+// Implemented by the application, invoked at the end of every interrupt with its duration in CPU cycles
+extern void tud_dcd_isr_probe_cb(uint32_t cycles, uint32_t int_status);
+#endif
+
+#ifndef CFG_TUD_DCD_SOF_PROBE
+#define CFG_TUD_DCD_SOF_PROBE 0
+#endif
+
+#if CFG_TUD_DCD_SOF_PROBE
+// Implemented by the application, invoked from the interrupt on every SOF with the frame number
+extern void tud_dcd_sof_probe_cb(uint32_t frame_number);
+#endif
+
 // Max number of bi-directional endpoints including EP0
 // Note: ESP32S2 specs say there are only up to 5 IN active endpoints include EP0
 // We should probably prohibit enabling Endpoint IN > 4 (not done yet)
@@ -201,6 +220,10 @@ void dcd_init(uint8_t rhport)
                  USB_RESETDETMSK_M |
                  USB_DISCONNINTMSK_M; // host most only
 
+#if CFG_TUD_DCD_SOF_PROBE
+  USB0.gintmsk |= USB_SOFMSK_M;
+#endif
+
   dcd_connect(rhport);
 }
 
@@ -757,6 +780,9 @@ static void _dcd_int_handler(void* arg)
 {
   (void) arg;
   uint8_t const rhport = 0;
+#if CFG_TUD_DCD_ISR_PROBE
+  uint32_t const probe_start = esp_cpu_get_cycle_count();
+#endif
 
   const uint32_t int_msk = USB0.gintmsk;
   const uint32_t int_status = USB0.gintsts & int_msk;
@@ -815,8 +841,12 @@ static void _dcd_int_handler(void* arg)
   if (int_status & USB_SOF_M) {
     USB0.gintsts = USB_SOF_M;
 
+#if CFG_TUD_DCD_SOF_PROBE
+    tud_dcd_sof_probe_cb((USB0.dsts >> USB_SOFFN_S) & USB_SOFFN_V);
+#else
     // Disable SOF interrupt since currently only used for remote wakeup detection
     USB0.gintmsk &= ~USB_SOFMSK_M;
+#endif
 
     dcd_event_bus_signal(rhport, DCD_EVENT_SOF, true);
   }
@@ -863,6 +893,10 @@ static void _dcd_int_handler(void* arg)
                   USB_INCOMPIP_M    |
                   USB_FETSUSP_M     |
                   USB_PTXFEMP_M;
+
+#if CFG_TUD_DCD_ISR_PROBE
+  tud_dcd_isr_probe_cb(esp_cpu_get_cycle_count() - probe_start, int_status);
+#endif
 }
 
 void dcd_int_enable (uint8_t rhport)
@@ -26,6 +26,7 @@
 #include "fuzz/fuzz_private.h"
 #include <assert.h>
 #include <cstdint>
+#include <cstring>
 #include <limits>
 
 #define UNUSED(x) (void)(x)
@@ -33,13 +34,29 @@
 //--------------------------------------------------------------------+
 // State tracker
 //--------------------------------------------------------------------+
+// Endpoint numbers are 4 bits wide on the bus.
+constexpr size_t kMaxEndpoints = 16;
+
+// A transfer the stack has queued and the fuzzer may later complete.
+struct PendingXfer {
+  uint8_t *buffer;
+  uint16_t total_bytes;
+  bool busy;
+};
+
 struct State {
   bool interrupts_enabled;
   bool sof_enabled;
   uint8_t address;
+  PendingXfer xfer[kMaxEndpoints][2];
 };
 
-static State state = {false, 0, 0};
+static State state = {false, 0, 0, {}};
+
+static PendingXfer *pending_xfer(uint8_t ep_addr) {
+  return &state.xfer[tu_edpt_number(ep_addr) & (kMaxEndpoints - 1)]
+                    [tu_edpt_dir(ep_addr)];
+}
 
 //--------------------------------------------------------------------+
 // Controller API
@@ -144,6 +161,11 @@ bool dcd_edpt_open(uint8_t rhport, tusb_desc_endpoint_t const *desc_ep) {
 // therefore required for multiple configuration support.
 void dcd_edpt_close_all(uint8_t rhport) {
   UNUSED(rhport);
+  // Keep control endpoint transfers, the stack never closes endpoint 0.
+  for (size_t epnum = 1; epnum < kMaxEndpoints; epnum++) {
+    state.xfer[epnum][TUSB_DIR_OUT].busy = false;
+    state.xfer[epnum][TUSB_DIR_IN].busy = false;
+  }
   return;
 }
 
@@ -152,7 +174,7 @@ void dcd_edpt_close_all(uint8_t rhport) {
 // calling it.
 void dcd_edpt_close(uint8_t rhport, uint8_t ep_addr) {
   UNUSED(rhport);
-  UNUSED(ep_addr);
+  pending_xfer(ep_addr)->busy = false;
   return;
 }
 
@@ -179,8 +201,12 @@ bool dcd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t *buffer,
   UNUSED(dont_optimise0);
   UNUSED(dont_optimise1);
 
-
-  return _fuzz_data_provider->ConsumeBool();
+  bool const accepted = _fuzz_data_provider->ConsumeBool();
+  if (accepted) {
+    // Remember the transfer so that fuzz_dcd_xfer_complete() can finish it.
+    *pending_xfer(ep_addr) = {buffer, total_bytes, true};
+  }
+  return accepted;
 }
 
 /* TODO: implement a fuzzed version of this.
@@ -192,7 +218,7 @@ bool dcd_edpt_xfer_fifo(uint8_t rhport, uint8_t ep_addr, tu_fifo_t *ff,
 void dcd_edpt_stall(uint8_t rhport, uint8_t ep_addr) {
 
   UNUSED(rhport);
-  UNUSED(ep_addr);
+  pending_xfer(ep_addr)->busy = false;
   return;
 }
 
@@ -205,4 +231,31 @@ void dcd_edpt_clear_stall(uint8_t rhport, uint8_t ep_addr) {
   UNUSED(ep_addr);
   return;
 }
-}
\ No newline at end of file
+
+//--------------------------------------------------------------------+
+// Fuzzer API
+//--------------------------------------------------------------------+
+
+bool fuzz_dcd_xfer_complete(uint8_t rhport, uint8_t ep_addr,
+                            const uint8_t *data, uint16_t len) {
+  PendingXfer *xfer = pending_xfer(ep_addr);
+  if (!xfer->busy) {
+    return false;
+  }
+  xfer->busy = false;
+
+  uint16_t xferred_bytes = xfer->total_bytes;
+  if (tu_edpt_dir(ep_addr) == TUSB_DIR_OUT) {
+    // The controller never writes past the buffer it was given, a longer
+    // packet is truncated the same way.
+    xferred_bytes = tu_min16(len, xfer->total_bytes);
+    if (xferred_bytes) {
+      memcpy(xfer->buffer, data, xferred_bytes);
+    }
+  }
+
+  dcd_event_xfer_complete(rhport, ep_addr, xferred_bytes,
+                          XFER_RESULT_SUCCESS, true);
+  return true;
+}
+}
@@ -0,0 +1,401 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <cassert>
+#include <fuzzer/FuzzedDataProvider.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "device/dcd.h"
+#include "fuzz/fuzz.h"
+#include "tusb.h"
+#include "usb_descriptors.h"
+#include <cstdint>
+#include <vector>
+
+#if AUDIO_FUZZ_REPLAY
+#include "fuzz/fuzz_private.h"
+#include <fstream>
+#include <iterator>
+#include <time.h>
+#endif
+
+extern "C" {
+
+#define FUZZ_ITERATIONS 500
+
+// Packets streamed per alternate setting by the replay throughput run
+#ifndef REPLAY_PACKETS
+#define REPLAY_PACKETS 1000000
+#endif
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF PROTYPES
+//--------------------------------------------------------------------+
+
+// Host side actions, each is run to completion before the next one
+enum AudioHostActions {
+  kBusInterrupt,
+  kEntityRequest,
+  kSetInterface,
+  kIsoOutPacket,
+  kMaxValue,
+};
+
+static void host_enumerate(void);
+static void host_set_interface(uint8_t alt);
+static void host_iso_out(uint8_t const *data, uint16_t len);
+static void fuzz_entity_request(FuzzedDataProvider *provider);
+
+// Packets handed to the application through audiod_rx_done_cb()
+static uint32_t rx_packets;
+static uint8_t rx_buffer[CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ];
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
+  FuzzedDataProvider provider(Data, Size);
+  std::vector<uint8_t> callback_data = provider.ConsumeBytes<uint8_t>(
+      provider.ConsumeIntegralInRange<size_t>(0, Size));
+  fuzz_init(callback_data.data(), callback_data.size());
+  // init device stack on configured roothub port
+  tud_init(BOARD_TUD_RHPORT);
+
+  // Start configured so iterations are spent in the class driver rather
+  // than in enumeration, the controller can still refuse the endpoints.
+  host_enumerate();
+
+  for (int i = 0; i < FUZZ_ITERATIONS; i++) {
+    if (provider.remaining_bytes() == 0) {
+      return 0;
+    }
+    switch (provider.ConsumeEnum<AudioHostActions>()) {
+    case kBusInterrupt:
+      tud_int_handler(provider.ConsumeIntegral<uint8_t>());
+      tud_task(); // tinyusb device task
+      break;
+    case kEntityRequest:
+      fuzz_entity_request(&provider);
+      break;
+    case kSetInterface:
+      // One past the last alternate setting to exercise the error path
+      host_set_interface(provider.ConsumeIntegralInRange<uint8_t>(0, 3));
+      break;
+    case kIsoOutPacket: {
+      // Up to a few bytes past the largest endpoint size, longer packets are
+      // truncated by the controller.
+      std::vector<uint8_t> packet = provider.ConsumeBytes<uint8_t>(
+          provider.ConsumeIntegralInRange<size_t>(
+              0, CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX + 8));
+      host_iso_out(packet.data(), (uint16_t)packet.size());
+    } break;
+    case kMaxValue:
+      // Noop.
+      break;
+    }
+  }
+
+  return 0;
+}
+
+//--------------------------------------------------------------------+
+// Host model
+//--------------------------------------------------------------------+
+
+// Run a control transfer through SETUP, data and status stages, completing
+// every transfer the stack queues on the control endpoint.
+static void host_control(uint8_t bmRequestType, uint8_t bRequest,
+                         uint16_t wValue, uint16_t wIndex, uint16_t wLength,
+                         uint8_t const *data) {
+  uint8_t const setup[8] = {
+      bmRequestType,       bRequest,
+      tu_u16_low(wValue),  tu_u16_high(wValue),
+      tu_u16_low(wIndex),  tu_u16_high(wIndex),
+      tu_u16_low(wLength), tu_u16_high(wLength)};
+  bool const dir_in = bmRequestType & TUSB_DIR_IN_MASK;
+
+  dcd_event_setup_received(BOARD_TUD_RHPORT, setup, false);
+  tud_task();
+
+  // Data stage is split into packets of the control endpoint size
+  uint8_t const ep_data = dir_in ? 0x80 : 0x00;
+  for (uint16_t offset = 0; offset < wLength;
+       offset += CFG_TUD_ENDPOINT0_SIZE) {
+    uint16_t const len = tu_min16(wLength - offset, CFG_TUD_ENDPOINT0_SIZE);
+    if (!fuzz_dcd_xfer_complete(BOARD_TUD_RHPORT, ep_data,
+                                data ? data + offset : NULL, len)) {
+      break;
+    }
+    tud_task();
+  }
+
+  // Status stage is a zero length packet in the opposite direction
+  uint8_t const ep_status = (wLength && dir_in) ? 0x00 : 0x80;
+  if (fuzz_dcd_xfer_complete(BOARD_TUD_RHPORT, ep_status, NULL, 0)) {
+    tud_task();
+  }
+}
+
+static void host_enumerate(void) {
+  dcd_event_bus_reset(BOARD_TUD_RHPORT, TUSB_SPEED_FULL, false);
+  tud_task();
+  host_control(0x00, TUSB_REQ_SET_CONFIGURATION, 1, 0, 0, NULL);
+}
+
+static void host_set_interface(uint8_t alt) {
+  host_control(0x01, TUSB_REQ_SET_INTERFACE, alt, ITF_NUM_AUDIO_STREAMING_SPK,
+               0, NULL);
+}
+
+static void host_iso_out(uint8_t const *data, uint16_t len) {
+  if (fuzz_dcd_xfer_complete(BOARD_TUD_RHPORT, EPNUM_AUDIO_OUT, data, len)) {
+    tud_task();
+  }
+}
+
+// Class specific request to an entity of the control interface, mostly
+// aimed at the entities and selectors the function implements.
+static void fuzz_entity_request(FuzzedDataProvider *provider) {
+  static uint8_t const entities[] = {
+      UAC2_ENTITY_CLOCK, UAC2_ENTITY_SPK_INPUT_TERMINAL,
+      UAC2_ENTITY_SPK_FEATURE_UNIT, UAC2_ENTITY_SPK_OUTPUT_TERMINAL};
+  static uint8_t const requests[] = {AUDIO_CS_REQ_CUR, AUDIO_CS_REQ_RANGE};
+
+  bool const get = provider->ConsumeBool();
+  uint8_t const entity = provider->ConsumeBool()
+                             ? provider->PickValueInArray(entities)
+                             : provider->ConsumeIntegral<uint8_t>();
+  uint8_t const request = provider->ConsumeBool()
+                              ? provider->PickValueInArray(requests)
+                              : provider->ConsumeIntegral<uint8_t>();
+  uint8_t const selector = provider->ConsumeIntegralInRange<uint8_t>(0, 0x10);
+  uint8_t const channel = provider->ConsumeIntegralInRange<uint8_t>(
+      0, CFG_TUD_AUDIO_FUNC_1_N_CHANNELS_RX + 1);
+  uint16_t const length = provider->ConsumeIntegralInRange<uint16_t>(
+      0, CFG_TUD_AUDIO_FUNC_1_CTRL_BUF_SZ + 8);
+
+  std::vector<uint8_t> data = provider->ConsumeBytes<uint8_t>(length);
+  data.resize(length);
+
+  // Class request to interface: 0xA1 for GET, 0x21 for SET
+  host_control(get ? 0xA1 : 0x21, request, tu_u16(selector, channel),
+               tu_u16(entity, ITF_NUM_AUDIO_CONTROL), length, data.data());
+}
+
+//--------------------------------------------------------------------+
+// Audio Callback API Implementations
+// A small model of the application, enough for the driver to reach
+// every request and streaming path.
+//--------------------------------------------------------------------+
+
+static uint32_t sample_rate = 48000;
+static int8_t mute;
+static int16_t volume[CFG_TUD_AUDIO_FUNC_1_N_CHANNELS_RX + 1];
+
+bool tud_audio_get_req_entity_cb(uint8_t rhport,
+                                 tusb_control_request_t const *p_request) {
+  audio_control_request_t const *request =
+      (audio_control_request_t const *)p_request;
+
+  if (request->bEntityID == UAC2_ENTITY_CLOCK &&
+      request->bControlSelector == AUDIO_CS_CTRL_SAM_FREQ) {
+    if (request->bRequest == AUDIO_CS_REQ_CUR) {
+      audio_control_cur_4_t curf = {(int32_t)tu_htole32(sample_rate)};
+      return tud_audio_buffer_and_schedule_control_xfer(rhport, p_request,
+                                                        &curf, sizeof(curf));
+    }
+    if (request->bRequest == AUDIO_CS_REQ_RANGE) {
+      static uint32_t const rates[] = {44100, 48000, 96000};
+      audio_control_range_4_n_t(TU_ARRAY_SIZE(rates)) rangef;
+      rangef.wNumSubRanges = tu_htole16(TU_ARRAY_SIZE(rates));
+      for (size_t i = 0; i < TU_ARRAY_SIZE(rates); i++) {
+        rangef.subrange[i].bMin = (int32_t)rates[i];
+        rangef.subrange[i].bMax = (int32_t)rates[i];
+        rangef.subrange[i].bRes = 0;
+      }
+      return tud_audio_buffer_and_schedule_control_xfer(
+          rhport, p_request, &rangef, sizeof(rangef));
+    }
+  }
+  if (request->bEntityID == UAC2_ENTITY_SPK_FEATURE_UNIT &&
+      request->bRequest == AUDIO_CS_REQ_CUR) {
+    if (request->bControlSelector == AUDIO_FU_CTRL_MUTE) {
+      audio_control_cur_1_t mute1 = {mute};
+      return tud_audio_buffer_and_schedule_control_xfer(rhport, p_request,
+                                                        &mute1, sizeof(mute1));
+    }
+    if (request->bControlSelector == AUDIO_FU_CTRL_VOLUME &&
+        request->bChannelNumber < TU_ARRAY_SIZE(volume)) {
+      audio_control_cur_2_t cur_vol = {
+          (int16_t)tu_htole16(volume[request->bChannelNumber])};
+      return tud_audio_buffer_and_schedule_control_xfer(
+          rhport, p_request, &cur_vol, sizeof(cur_vol));
+    }
+  }
+  if (request->bEntityID == UAC2_ENTITY_SPK_OUTPUT_TERMINAL &&
+      request->bControlSelector == AUDIO_TE_CTRL_LATENCY &&
+      request->bRequest == AUDIO_CS_REQ_CUR) {
+    audio_control_cur_4_t cur_latency = {(int32_t)tu_htole32(30000000)};
+    return tud_audio_buffer_and_schedule_control_xfer(
+        rhport, p_request, &cur_latency, sizeof(cur_latency));
+  }
+  return false;
+}
+
+bool tud_audio_set_req_entity_cb(uint8_t rhport,
+                                 tusb_control_request_t const *p_request,
+                                 uint8_t *buf) {
+  (void)rhport;
+  audio_control_request_t const *request =
+      (audio_control_request_t const *)p_request;
+
+  TU_VERIFY(request->bRequest == AUDIO_CS_REQ_CUR);
+
+  if (request->bEntityID == UAC2_ENTITY_CLOCK &&
+      request->bControlSelector == AUDIO_CS_CTRL_SAM_FREQ) {
+    TU_VERIFY(request->wLength == sizeof(audio_control_cur_4_t));
+    sample_rate = (uint32_t)((audio_control_cur_4_t const *)buf)->bCur;
+    return true;
+  }
+  if (request->bEntityID == UAC2_ENTITY_SPK_FEATURE_UNIT) {
+    if (request->bControlSelector == AUDIO_FU_CTRL_MUTE) {
+      TU_VERIFY(request->wLength == sizeof(audio_control_cur_1_t));
+      mute = ((audio_control_cur_1_t const *)buf)->bCur;
+      return true;
+    }
+    if (request->bControlSelector == AUDIO_FU_CTRL_VOLUME) {
+      TU_VERIFY(request->wLength == sizeof(audio_control_cur_2_t));
+      TU_VERIFY(request->bChannelNumber < TU_ARRAY_SIZE(volume));
+      volume[request->bChannelNumber] =
+          ((audio_control_cur_2_t const *)buf)->bCur;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool tud_audio_set_itf_close_EP_cb(uint8_t rhport,
+                                   tusb_control_request_t const *p_request) {
+  (void)rhport;
+  (void)p_request;
+  return true;
+}
+
+bool tud_audio_set_itf_cb(uint8_t rhport,
+                          tusb_control_request_t const *p_request) {
+  (void)rhport;
+  (void)p_request;
+  return true;
+}
+
+// Read after the driver moved the packet into the FIFO, with the linear
+// buffer the fuzz controller uses the data is not there yet in pre_read.
+bool tud_audio_rx_done_post_read_cb(uint8_t rhport, uint16_t n_bytes_received,
+                                    uint8_t func_id, uint8_t ep_out,
+                                    uint8_t cur_alt_setting) {
+  (void)rhport;
+  (void)func_id;
+  (void)ep_out;
+  (void)cur_alt_setting;
+
+  rx_packets++;
+  return tud_audio_read(rx_buffer, n_bytes_received) == n_bytes_received;
+}
+}
+
+//--------------------------------------------------------------------+
+// Replay
+// Without libFuzzer the target runs corpus files given on the command line,
+// then streams iso OUT packets to measure the class driver packet rate.
+//--------------------------------------------------------------------+
+
+#if AUDIO_FUZZ_REPLAY
+
+// Controller decisions all come out as "accept" while streaming
+static uint8_t accept_all[4096];
+
+static double elapsed_s(struct timespec const *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) +
+         (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void replay_throughput(uint8_t alt, uint8_t bytes_per_sample) {
+  fuzz_init(accept_all, sizeof(accept_all));
+  tud_init(BOARD_TUD_RHPORT);
+  host_enumerate();
+  host_set_interface(alt);
+
+  // One 48kHz frame worth of samples, what the host sends every 1ms
+  std::vector<uint8_t> packet(48 * CFG_TUD_AUDIO_FUNC_1_N_CHANNELS_RX *
+                              bytes_per_sample);
+  for (size_t i = 0; i < packet.size(); i++) {
+    packet[i] = (uint8_t)i;
+  }
+
+  uint32_t const start_packets = rx_packets;
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (uint32_t i = 0; i < REPLAY_PACKETS; i++) {
+    // Every re-arm of the OUT endpoint consumes a decision
+    if (_fuzz_data_provider->remaining_bytes() < 16) {
+      fuzz_init(accept_all, sizeof(accept_all));
+    }
+    host_iso_out(packet.data(), (uint16_t)packet.size());
+  }
+
+  double const seconds = elapsed_s(&start);
+  uint32_t const packets = rx_packets - start_packets;
+  printf("alt %u: %u of %u packets x %u bytes in %.3f s, %.0f packets/s "
+         "(%.0fx real time)\n",
+         alt, (unsigned)packets, (unsigned)REPLAY_PACKETS,
+         (unsigned)packet.size(), seconds, packets / seconds,
+         packets / seconds / 1000.0);
+
+  host_set_interface(0);
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    std::ifstream file(argv[i], std::ios::binary);
+    if (!file) {
+      fprintf(stderr, "cannot open %s\n", argv[i]);
+      return 1;
+    }
+    std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)),
+                               std::istreambuf_iterator<char>());
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+  }
+  if (argc > 1) {
+    printf("%d inputs, %u packets reached the application\n", argc - 1,
+           (unsigned)rx_packets);
+  }
+
+  memset(accept_all, 0xff, sizeof(accept_all));
+  replay_throughput(1, CFG_TUD_AUDIO_FUNC_1_FORMAT_1_N_BYTES_PER_SAMPLE_RX);
+  replay_throughput(2, CFG_TUD_AUDIO_FUNC_1_FORMAT_2_N_BYTES_PER_SAMPLE_RX);
+  return 0;
+}
+
+#endif // AUDIO_FUZZ_REPLAY
@@ -24,6 +24,8 @@
  */
 
 #pragma once
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -32,6 +34,13 @@ extern "C" {
 
 int fuzz_init(const uint8_t *data, size_t size);
 
+// Complete the transfer the stack queued on ep_addr, as the controller would
+// once the host has moved the data. OUT data is copied into the queued buffer,
+// IN transfers always complete in full and ignore data. Returns false if no
+// transfer is queued on the endpoint.
+bool fuzz_dcd_xfer_complete(uint8_t rhport, uint8_t ep_addr,
+                            const uint8_t *data, uint16_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,17 +1,236 @@
 #include "audio.h"
 #include "es8156.h"
+#include "pcm.h"
+#include "settings.h"
+#include "profile.h"
+#include "latency.h"
+#include "verify.h"
+#include "power.h"
+#include "trace.h"
+#include "events.h"
 #include "global.h"
+#include "tasks.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
 #include "driver/i2s_std.h"
 #include "driver/gpio.h"
 #include "esp_check.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <string.h>
+#if CONFIG_AUDIO_LED_METER
+#include "led.h"
+#include "reactor.h"
+#include <math.h>
+#endif
 
 const static char* TAG = "audio";
 
+/**
+ * Power states of the output path
+ *
+ * IDLE      -> codec powered, I2S disabled, waiting for a stream
+ * STREAMING -> codec powered, I2S enabled
+ * STANDBY   -> codec in standby, I2S disabled (USB suspend or idle timeout)
+*/
+typedef enum {
+    AUDIO_POWER_IDLE,
+    AUDIO_POWER_STREAMING,
+    AUDIO_POWER_STANDBY,
+} audio_power_state_t;
+
+static const char* const POWER_STATE_NAMES[] = {"idle", "streaming", "standby"};
+static const char* const OVERRUN_POLICY_NAMES[AUDIO_OVERRUN_MAX] = {"drop-newest", "drop-oldest", "stretch"};
+
+#if CONFIG_AUDIO_OVERRUN_DROP_NEWEST
+#define AUDIO_OVERRUN_DEFAULT   AUDIO_OVERRUN_DROP_NEWEST
+#elif CONFIG_AUDIO_OVERRUN_DROP_OLDEST
+#define AUDIO_OVERRUN_DEFAULT   AUDIO_OVERRUN_DROP_OLDEST
+#else
+#define AUDIO_OVERRUN_DEFAULT   AUDIO_OVERRUN_STRETCH
+#endif
+
+// Largest packet, 1 ms at 96 kHz in 32 bit slots
+#define AUDIO_PACKET_MAX        (96 * 8)
+// Data waiting for the DMA buffers beyond one of them, before the overrun policy applies
+#define AUDIO_PENDING_SLACK     2   // packets
+#define AUDIO_PENDING_SIZE      (AUDIO_DMA_BUFFER_MAX + AUDIO_PENDING_SLACK * AUDIO_PACKET_MAX)
+// AUDIO_OVERRUN_STRETCH merges at most one frame in this many of a packet
+#define AUDIO_STRETCH_RATIO     8
+
+#if CONFIG_AUDIO_GAIN_RAMP_EXPONENTIAL
+#define AUDIO_GAIN_RAMP_SHAPE   PCM_RAMP_EXPONENTIAL
+#else
+#define AUDIO_GAIN_RAMP_SHAPE   PCM_RAMP_LINEAR
+#endif
+
+#if CONFIG_AUDIO_LED_METER
+#define AUDIO_METER             (&mMeter)
+#else
+#define AUDIO_METER             NULL
+#endif
+
 static bool mI2sInitialized = false;
+static bool mI2sEnabled = false;
 static i2s_chan_handle_t mHandleTx = NULL;
+static audio_stream_config_t mStreamConfig = {0};
+static uint32_t mDmaDescNum = 0;
+static uint32_t mDmaFrameNum = 0;
+// DMA buffering requested with audio_set_dma_buffers(), 0 derives it from CONFIG_AUDIO_DMA_LATENCY_MS
+static uint32_t mDmaDescNumRequested = 0;
+static uint32_t mDmaFrameNumRequested = 0;
+static bool mDmaReconfigure = false;
+
+// Counters since boot
+static volatile uint32_t mUnderruns = 0;
+static volatile uint32_t mOverruns = 0;
+static volatile uint32_t mConcealedFrames = 0;
+static volatile uint32_t mDroppedBytes = 0;
+static volatile uint32_t mStretchedFrames = 0;
+
+/**
+ * Converted data that did not fit into the DMA buffers within the wait, written ahead
+ * of the next packet. The I2S driver only frees a whole DMA buffer at a time, so up
+ * to one of them waits here in steady state. Beyond mPendingLimit the overrun policy
+ * decides what is given up. Only the audio path, one task at a time, touches it.
+*/
+static uint8_t mPending[AUDIO_PENDING_SIZE] __attribute__((aligned(4)));
+static size_t mPendingBytes = 0;
+static uint32_t mPendingPhase = 0;          // bytes of the stream written into its current frame
+static size_t mPendingLimit = AUDIO_PENDING_SIZE;
+static audio_overrun_policy_t mOverrunPolicy = AUDIO_OVERRUN_DEFAULT;
+static uint32_t mStreamDroppedBytes = 0;    // mDroppedBytes at stream start
+
+// audio_play() in progress, audio_start() waits for a packet of the previous writer to finish
+static volatile bool mPlaying = false;
+
+// Stream positions of the current stream, the DMA fill level is derived from them
+static volatile uint32_t mBytesPerFrame = 4;
+static volatile uint32_t mBytesWritten = 0;
+static volatile uint32_t mBytesSent = 0;
+static volatile uint32_t mUnderrunBytes = 0;
+
+static SemaphoreHandle_t mPowerLock = NULL;
+static StaticSemaphore_t mPowerLockBuf;
+static audio_power_state_t mPowerState = AUDIO_POWER_IDLE;
+static esp_timer_handle_t mIdleTimer = NULL;
+static uint8_t mVolumeReg = 0;
+static bool mMuted = false;
+
+// Silence detection, counted in the audio path and applied from mSilenceTimer
+static esp_timer_handle_t mSilenceTimer = NULL;
+static uint64_t mSilenceThresholdBytes = 0;
+static uint64_t mSilentBytes = 0;
+static volatile bool mSilenceRequested = false;
+static bool mSilenced = false;
+
+// Gain fused into the PCM conversion, stays at unity without CONFIG_AUDIO_SOFT_VOLUME
+static pcm_gain_t mGain;
+
+#if CONFIG_AUDIO_SOFT_VOLUME
+// Targets are handed to the audio path through a sequence number
+static volatile int32_t mGainTarget[PCM_CHANNELS] = {PCM_GAIN_UNITY, PCM_GAIN_UNITY};
+static volatile uint32_t mGainSeq = 0;
+static uint32_t mGainSeqApplied = 0;
+static float mSoftVolumeDb[1 + PCM_CHANNELS] = {0};  // master, then per channel
+static bool mSoftMuted = false;
+#endif
+
+#if CONFIG_AUDIO_LED_METER
+// Level accumulated by the conversion kernels, handed to the reactor once per meter period,
+// the level in dB and the brightness are kept there
+static pcm_meter_t mMeter;
+static float mMeterLevelDb = 0;
+static uint8_t mMeterBrightness = 0;
+#endif
+
+static bool IRAM_ATTR audio_i2s_on_sent(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    mBytesSent += event->size;
+    TRACE(I2S_SENT, event->size, 0);
+#if CONFIG_AUDIO_LATENCY
+    latency_consumed(event->size);
+#endif
+    return false;
+}
+
+static bool IRAM_ATTR audio_i2s_on_send_q_ovf(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    // The buffer was played again without new data, auto_clear made it silence
+    mUnderruns++;
+    mUnderrunBytes += event->size;
+    mConcealedFrames += event->size / mBytesPerFrame;
+    TRACE(I2S_UNDERRUN, event->size, 0);
+#if CONFIG_AUDIO_LATENCY
+    latency_underrun(event->size);
+#endif
+    return false;
+}
+
+// Buffer count of the derived geometry, more only when the buffers would exceed AUDIO_DMA_BUFFER_MAX
+#define AUDIO_DMA_DESC_NUM_AUTO     6
+#define AUDIO_DMA_FRAME_NUM_MIN     8
+// A channel within 1/8 of the target buffering is kept across format changes
+#define AUDIO_DMA_TOLERANCE_SHIFT   3
+
+/**
+ * @brief Bytes per frame in the DMA buffers, slots are as wide as the samples (3 bytes at 24 bit)
+*/
+static inline uint32_t audio_dma_frame_bytes(const audio_stream_config_t *config)
+{
+    return PCM_CHANNELS * (config->bits_per_sample / 8);
+}
+
+/**
+ * @brief Largest DMA buffer in frames
+*/
+static uint32_t audio_dma_frame_max(const audio_stream_config_t *config)
+{
+    return AUDIO_DMA_BUFFER_MAX / audio_dma_frame_bytes(config);
+}
+
+/**
+ * @brief DMA geometry of a stream format, the requested one or CONFIG_AUDIO_DMA_LATENCY_MS of audio
+*/
+static void audio_dma_geometry(const audio_stream_config_t *config, uint32_t *desc_num, uint32_t *frame_num)
+{
+    if(mDmaDescNumRequested) {
+        *desc_num = mDmaDescNumRequested;
+        *frame_num = mDmaFrameNumRequested;
+        return;
+    }
+
+    uint32_t frame_max = audio_dma_frame_max(config);
+    uint32_t frames = config->sample_rate_hz * CONFIG_AUDIO_DMA_LATENCY_MS / 1000;
+    uint32_t desc = (frames + frame_max - 1) / frame_max;
+    if(desc < AUDIO_DMA_DESC_NUM_AUTO) desc = AUDIO_DMA_DESC_NUM_AUTO;
+    if(desc > AUDIO_DMA_DESC_NUM_MAX) desc = AUDIO_DMA_DESC_NUM_MAX;
+
+    uint32_t frame = (frames + desc - 1) / desc;
+    if(frame < AUDIO_DMA_FRAME_NUM_MIN) frame = AUDIO_DMA_FRAME_NUM_MIN;
+    if(frame > frame_max) frame = frame_max;
+    *desc_num = desc;
+    *frame_num = frame;
+}
+
+/**
+ * @brief Whether the current channel can play a format with the geometry derived for it
+ *
+ * The driver resizes the buffers itself for a new bit depth, only the frame count is
+ * fixed. A requested geometry must match exactly, a derived one within the tolerance.
+*/
+static bool audio_dma_fits(const audio_stream_config_t *config, uint32_t desc_num, uint32_t frame_num)
+{
+    if(mDmaFrameNum > audio_dma_frame_max(config)) return false;
+    uint32_t target = desc_num * frame_num;
+    uint32_t current = mDmaDescNum * mDmaFrameNum;
+    uint32_t diff = current > target ? current - target : target - current;
+    return diff <= (mDmaDescNumRequested ? 0 : target >> AUDIO_DMA_TOLERANCE_SHIFT);
+}
 
-static esp_err_t init_i2s_driver(audio_stream_config_t *config)
+static esp_err_t init_i2s_driver(audio_stream_config_t *config, uint32_t desc_num, uint32_t frame_num)
 {
     i2s_std_config_t std_cfg = {
         .clk_cfg = {
@@ -37,18 +256,357 @@ static esp_err_t init_i2s_driver(audio_stream_config_t *config)
         },
     };
 
+    // The driver allocates the DMA interrupt on the calling core, see tasks.h
+    if(esp_cpu_get_core_id() != TASK_CORE_AUDIO) {
+        ESP_LOGW(TAG, "I2S channel created on core %d, its interrupt is not on the audio core", esp_cpu_get_core_id());
+    }
+
     // Setup I2S peripheral
     i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(AUDIO_I2S_NUM, I2S_ROLE_MASTER);
     chan_cfg.auto_clear = true; // Auto clear the legacy data in the DMA buffer
+    chan_cfg.dma_desc_num = desc_num;
+    chan_cfg.dma_frame_num = frame_num;
     ESP_RETURN_ON_ERROR(i2s_new_channel(&chan_cfg, &mHandleTx, NULL), TAG, "i2s new channel failed");
-    
+    mDmaDescNum = chan_cfg.dma_desc_num;
+    mDmaFrameNum = chan_cfg.dma_frame_num;
+
     // Setup I2S channels
     ESP_RETURN_ON_ERROR(i2s_channel_init_std_mode(mHandleTx, &std_cfg), TAG, "i2s channel init failed");
 
+    i2s_event_callbacks_t cbs = {
+        .on_sent = audio_i2s_on_sent,
+        .on_send_q_ovf = audio_i2s_on_send_q_ovf,
+    };
+    ESP_RETURN_ON_ERROR(i2s_channel_register_event_callback(mHandleTx, &cbs, NULL), TAG, "i2s register callback failed");
+
+    return ESP_OK;
+}
+
+static esp_err_t audio_configure_i2s(audio_stream_config_t *config)
+{
+    uint32_t desc_num, frame_num;
+    audio_dma_geometry(config, &desc_num, &frame_num);
+
+    // DMA buffers are allocated with the channel, recreate it to resize them
+    if(mI2sInitialized && (mDmaReconfigure || !audio_dma_fits(config, desc_num, frame_num))) {
+        ESP_RETURN_ON_ERROR(i2s_del_channel(mHandleTx), TAG, "i2s delete channel failed");
+        mHandleTx = NULL;
+        mI2sInitialized = false;
+    }
+    mDmaReconfigure = false;
+
+    if(!mI2sInitialized) {
+        ESP_RETURN_ON_ERROR(init_i2s_driver(config, desc_num, frame_num), TAG, "init i2s driver failed");
+        mI2sInitialized = true;
+        ESP_LOGI(TAG, "DMA buffers %lu x %lu frames, %lu us", mDmaDescNum, mDmaFrameNum,
+                (uint32_t)((uint64_t)mDmaDescNum * mDmaFrameNum * 1000000 / config->sample_rate_hz));
+        return ESP_OK;
+    }
+
+    i2s_std_clk_config_t clk_cfg = {
+        .sample_rate_hz = config->sample_rate_hz,
+        .clk_src = I2S_CLK_SRC_DEFAULT,
+        .mclk_multiple = AUDIO_MCLK_MULTIPLE,
+    };
+    i2s_std_slot_config_t slot_cfg = {
+        .data_bit_width = config->bits_per_sample,
+        .slot_bit_width = config->bits_per_sample,
+        .slot_mode = I2S_SLOT_MODE_STEREO,
+        .slot_mask = I2S_STD_SLOT_BOTH,
+        .ws_width = config->bits_per_sample,
+        .ws_pol = false,
+        .bit_shift = true
+    };
+
+    ESP_RETURN_ON_ERROR(i2s_channel_reconfig_std_clock(mHandleTx, &clk_cfg), TAG, "i2s channel reconfig clock failed");
+    ESP_RETURN_ON_ERROR(i2s_channel_reconfig_std_slot(mHandleTx, &slot_cfg), TAG, "i2s channel reconfig slot failed");
+    return ESP_OK;
+}
+
+/**
+ * @brief Disable the I2S channel if it is running, caller must hold mPowerLock
+*/
+static esp_err_t audio_disable_i2s()
+{
+    if(!mI2sEnabled) return ESP_OK;
+    mI2sEnabled = false;
+    return i2s_channel_disable(mHandleTx);
+}
+
+/**
+ * @brief Put codec and I2S into standby, caller must hold mPowerLock
+*/
+static esp_err_t audio_power_standby(const char *reason)
+{
+    if(mPowerState == AUDIO_POWER_STANDBY) return ESP_OK;
+
+    int64_t start = esp_timer_get_time();
+    audio_power_state_t from = mPowerState;
+
+    esp_timer_stop(mIdleTimer);
+    esp_err_t ret = audio_disable_i2s();
+    ret |= es8156_standby();
+    mPowerState = AUDIO_POWER_STANDBY;
+    TRACE(POWER, from, AUDIO_POWER_STANDBY);
+
+    ESP_LOGI(TAG, "Power %s -> standby (%s) in %lld us", POWER_STATE_NAMES[from], reason, esp_timer_get_time() - start);
+    return ret == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * @brief Bring the codec out of standby with the cached volume
+*/
+static esp_err_t audio_codec_resume()
+{
+    ESP_RETURN_ON_ERROR(es8156_resume(), TAG, "es8156 resume failed");
+    // es8156_resume() restores a fixed volume, put ours back
+    return es8156_codec_set_voice_volume(mVolumeReg);
+}
+
+/**
+ * @brief Leave standby and restore the codec state, caller must hold mPowerLock
+*/
+static esp_err_t audio_power_wake()
+{
+    if(mPowerState != AUDIO_POWER_STANDBY) return ESP_OK;
+
+    ESP_RETURN_ON_ERROR(audio_codec_resume(), TAG, "codec resume failed");
+    mPowerState = AUDIO_POWER_IDLE;
+    TRACE(POWER, AUDIO_POWER_STANDBY, AUDIO_POWER_IDLE);
     return ESP_OK;
 }
 
+/**
+ * @brief Mute or standby the codec on silence and undo it, caller must hold mPowerLock
+*/
+static esp_err_t audio_silence_apply(bool silence)
+{
+    if(silence == mSilenced) return ESP_OK;
+    // Standby already keeps the codec quiet, wake restores it
+    if(mPowerState == AUDIO_POWER_STANDBY) {
+        mSilenced = false;
+        return ESP_OK;
+    }
+
+    int64_t start = esp_timer_get_time();
+    mSilenced = silence;
+    TRACE(SILENCE, silence, 0);
+#if CONFIG_AUDIO_SILENCE_ACTION_STANDBY
+    esp_err_t ret = silence ? es8156_standby() : audio_codec_resume();
+#else
+    esp_err_t ret = es8156_codec_set_voice_mute(0, silence || mMuted);
+#endif
+
+    ESP_LOGI(TAG, "Silence %s in %lld us", silence ? "enter" : "leave", esp_timer_get_time() - start);
+    return ret;
+}
+
+static void audio_silence_timer_cb(void *arg)
+{
+    xSemaphoreTake(mPowerLock, portMAX_DELAY);
+    audio_silence_apply(mSilenceRequested);
+    xSemaphoreGive(mPowerLock);
+}
+
+/**
+ * @brief Count consecutive silent bytes and hand codec changes to mSilenceTimer
+ *
+ * The I2C transaction never runs in the audio path. The first non-zero frame is
+ * queued to I2S right away, the unmute lands long before it leaves the DMA buffers.
+*/
+static inline void audio_silence_update(const void *data, size_t size)
+{
+#if CONFIG_AUDIO_SILENCE_TIMEOUT_MS > 0
+    if(pcm_is_silent(data, size)) {
+        mSilentBytes += size;
+        if(mSilenceRequested || mSilentBytes < mSilenceThresholdBytes) return;
+        mSilenceRequested = true;
+    } else {
+        mSilentBytes = 0;
+        if(!mSilenceRequested) return;
+        mSilenceRequested = false;
+    }
+    // Already pending is fine, the callback picks up the latest request
+    esp_timer_start_once(mSilenceTimer, 0);
+#endif
+}
+
+#if CONFIG_AUDIO_PCM_BENCHMARK
+#define AUDIO_BENCHMARK_ROUNDS  1000
+#define AUDIO_BENCHMARK_FRAMES  96  // 1 ms at 96 kHz
+
+/**
+ * @brief Measure the PCM kernels on a silent 1 ms frame at 96 kHz/24-bit (worst case for the detector: full sweep)
+*/
+static void audio_pcm_benchmark()
+{
+    static int32_t frame[AUDIO_BENCHMARK_FRAMES * 2];
+    pcm_gain_t gain;
+    const int32_t mute[PCM_CHANNELS] = {PCM_GAIN_MUTE, PCM_GAIN_MUTE};
+    uint32_t start, silence, passthrough, ramped, metered;
+
+    start = esp_cpu_get_cycle_count();
+    for(int i = 0; i < AUDIO_BENCHMARK_ROUNDS; i++) {
+        pcm_is_silent(frame, AUDIO_BENCHMARK_FRAMES * 2 * 3);
+    }
+    silence = (esp_cpu_get_cycle_count() - start) / AUDIO_BENCHMARK_ROUNDS;
+
+    pcm_gain_init(&gain, PCM_GAIN_UNITY, AUDIO_GAIN_RAMP_SHAPE);
+    start = esp_cpu_get_cycle_count();
+    for(int i = 0; i < AUDIO_BENCHMARK_ROUNDS; i++) {
+        pcm_convert_s32_to_s24(&gain, NULL, frame, AUDIO_BENCHMARK_FRAMES);
+    }
+    passthrough = (esp_cpu_get_cycle_count() - start) / AUDIO_BENCHMARK_ROUNDS;
+
+    // One long ramp so every measured frame is inside it
+    pcm_gain_set_ramp(&gain, AUDIO_BENCHMARK_FRAMES * AUDIO_BENCHMARK_ROUNDS + 1);
+    pcm_gain_ramp_to(&gain, mute);
+    start = esp_cpu_get_cycle_count();
+    for(int i = 0; i < AUDIO_BENCHMARK_ROUNDS; i++) {
+        pcm_convert_s32_to_s24(&gain, NULL, frame, AUDIO_BENCHMARK_FRAMES);
+    }
+    ramped = (esp_cpu_get_cycle_count() - start) / AUDIO_BENCHMARK_ROUNDS;
+
+    // The level meter's share, on top of the pass-through it forces to read the frame
+    pcm_meter_t meter;
+    pcm_meter_reset(&meter);
+    pcm_gain_init(&gain, PCM_GAIN_UNITY, AUDIO_GAIN_RAMP_SHAPE);
+    start = esp_cpu_get_cycle_count();
+    for(int i = 0; i < AUDIO_BENCHMARK_ROUNDS; i++) {
+        pcm_convert_s32_to_s24(&gain, &meter, frame, AUDIO_BENCHMARK_FRAMES);
+    }
+    metered = (esp_cpu_get_cycle_count() - start) / AUDIO_BENCHMARK_ROUNDS;
+
+    ESP_LOGI(TAG, "PCM cycles per 96 kHz/24-bit frame: silence detector %lu, convert pass-through %lu, convert with gain ramp %lu, "
+            "convert pass-through with level meter %lu", silence, passthrough, ramped, metered);
+}
+#endif
+
+#if CONFIG_AUDIO_LED_METER
+/**
+ * @brief Show the level of the last meter period on the LED, on the reactor
+ *
+ * Peaks are shown at once and fall back at the release rate. The LED is only
+ * notified when the brightness changes, a steady or silent stream costs nothing.
+ *
+ * @param value mean energy per sample with CONFIG_AUDIO_LED_METER_RMS, the peak otherwise
+*/
+static void audio_meter_publish(void *arg, uint32_t value)
+{
+#if CONFIG_AUDIO_LED_METER_RMS
+    // A full scale sample adds 2^30 to the energy
+    float level_db = 10.f * log10f((float)value / (float)(1UL << 30) + 1e-10f);
+#else
+    float level_db = 20.f * log10f((float)value / (float)INT32_MAX + 1e-10f);
+#endif
+
+    float release_db = mMeterLevelDb - (float)CONFIG_AUDIO_LED_METER_RELEASE_DB_PER_S / CONFIG_AUDIO_LED_METER_RATE_HZ;
+    mMeterLevelDb = level_db > release_db ? level_db : release_db;
+    if(mMeterLevelDb < -CONFIG_AUDIO_LED_METER_RANGE_DB) mMeterLevelDb = -CONFIG_AUDIO_LED_METER_RANGE_DB;
+
+    uint8_t brightness = (mMeterLevelDb + CONFIG_AUDIO_LED_METER_RANGE_DB) * 100 / CONFIG_AUDIO_LED_METER_RANGE_DB;
+    if(brightness == mMeterBrightness) return;
+    mMeterBrightness = brightness;
+    led_level(brightness, 1000 / CONFIG_AUDIO_LED_METER_RATE_HZ);
+}
+#endif
+
+/**
+ * @brief Hand the level of a completed meter period to the reactor
+ *
+ * The audio path only takes the reading, the dB scale and the LED stay off it.
+*/
+static inline void audio_meter_update()
+{
+#if CONFIG_AUDIO_LED_METER
+    if(mMeter.samples < PCM_CHANNELS * mStreamConfig.sample_rate_hz / CONFIG_AUDIO_LED_METER_RATE_HZ) return;
+
+#if CONFIG_AUDIO_LED_METER_RMS
+    uint32_t value = mMeter.energy / mMeter.samples;
+#else
+    uint32_t value = mMeter.peak;
+#endif
+    pcm_meter_reset(&mMeter);
+    // A full queue loses one period, the next one shows the level again
+    reactor_call(audio_meter_publish, NULL, value);
+#endif
+}
+
+#if CONFIG_AUDIO_SOFT_VOLUME
+/**
+ * @brief Publish a new software gain target, the audio path ramps to it
+*/
+static void audio_soft_gain_update()
+{
+    for(int ch = 0; ch < PCM_CHANNELS; ch++) {
+        float gain_db = mSoftVolumeDb[0] + mSoftVolumeDb[1 + ch] - CONFIG_AUDIO_SOFT_VOLUME_CEILING;
+        mGainTarget[ch] = mSoftMuted ? PCM_GAIN_MUTE : pcm_gain_from_db(gain_db);
+    }
+    mGainSeq++;
+    TRACE(GAIN, mGainTarget[0], mGainTarget[1]);
+}
+#endif
+
+/**
+ * @brief Set the codec volume register in dB, cached across standby
+*/
+static esp_err_t audio_set_codec_volume(float gain_db)
+{
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake(mPowerLock, portMAX_DELAY);
+    mVolumeReg = gain_db * 2 + 191;
+    // The codec volume is forced to minimum in standby, it is restored on wake
+    if(mPowerState != AUDIO_POWER_STANDBY) {
+        ret = es8156_codec_set_voice_volume(mVolumeReg);
+    }
+    xSemaphoreGive(mPowerLock);
+    return ret;
+}
+
+static void audio_idle_timer_cb(void *arg)
+{
+    xSemaphoreTake(mPowerLock, portMAX_DELAY);
+    // A stream may have been opened while we were waiting for the lock
+    if(mPowerState == AUDIO_POWER_IDLE) {
+        audio_power_standby("idle");
+    }
+    xSemaphoreGive(mPowerLock);
+}
+
+static void audio_usb_event_handler(const event_t *event, void *arg)
+{
+    int32_t id = event->id;
+    if(id == USB_EVENT_SUSPEND || id == USB_EVENT_UNMOUNT) {
+        xSemaphoreTake(mPowerLock, portMAX_DELAY);
+        audio_power_standby(id == USB_EVENT_SUSPEND ? "suspend" : "unmount");
+        xSemaphoreGive(mPowerLock);
+    }
+}
+
+static void audio_arm_idle_timer()
+{
+#if CONFIG_AUDIO_STANDBY_IDLE_TIMEOUT > 0
+    esp_timer_stop(mIdleTimer);
+    esp_timer_start_once(mIdleTimer, CONFIG_AUDIO_STANDBY_IDLE_TIMEOUT * 1000000ULL);
+#endif
+}
+
 esp_err_t audio_init() {
+    mPowerLock = xSemaphoreCreateMutexStatic(&mPowerLockBuf);
+
+    const esp_timer_create_args_t idle_timer_args = {
+        .callback = audio_idle_timer_cb,
+        .name = "audio_idle",
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&idle_timer_args, &mIdleTimer), TAG, "create idle timer failed");
+
+    const esp_timer_create_args_t silence_timer_args = {
+        .callback = audio_silence_timer_cb,
+        .name = "audio_silence",
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&silence_timer_args, &mSilenceTimer), TAG, "create silence timer failed");
+    ESP_RETURN_ON_ERROR(events_subscribe(USB_EVENT, ESP_EVENT_ANY_ID, audio_usb_event_handler, NULL), TAG, "register usb event handler failed");
+
     // Initialize I2C bus
     const i2c_config_t es_i2c_cfg = {
         .sda_io_num = PIN_DAC_SDA,
@@ -61,62 +619,358 @@ esp_err_t audio_init() {
     const i2c_bus_handle_t i2c_bus = i2c_bus_create(I2C_NUM_0, &es_i2c_cfg);
 
     ESP_RETURN_ON_ERROR(es8156_codec_init(i2c_bus), TAG, "es8156 codec init failed");
-    return audio_set_volume(AUDIO_VOLUME_DEFAULT);
+#if CONFIG_AUDIO_SOFT_VOLUME
+    // The codec stays at the ceiling, volume and mute are applied to the samples
+    pcm_gain_init(&mGain, PCM_GAIN_MUTE, AUDIO_GAIN_RAMP_SHAPE);
+    ESP_RETURN_ON_ERROR(audio_set_codec_volume(CONFIG_AUDIO_SOFT_VOLUME_CEILING), TAG, "set codec ceiling failed");
+#else
+    pcm_gain_init(&mGain, PCM_GAIN_UNITY, AUDIO_GAIN_RAMP_SHAPE);
+#endif
+    // Saved controls are applied before the first stream, see settings_init()
+    const settings_t *settings = settings_get();
+    ESP_RETURN_ON_ERROR(audio_set_volume(0, settings->volume[0] / 256.f), TAG, "set volume failed");
+#if CONFIG_AUDIO_SOFT_VOLUME
+    for(int ch = 1; ch <= PCM_CHANNELS; ch++) {
+        ESP_RETURN_ON_ERROR(audio_set_volume(ch, settings->volume[ch] / 256.f), TAG, "set channel volume failed");
+    }
+#endif
+    ESP_RETURN_ON_ERROR(audio_set_mute(0, settings->mute), TAG, "set mute failed");
+
+    audio_arm_idle_timer();
+
+#if CONFIG_AUDIO_PCM_BENCHMARK
+    audio_pcm_benchmark();
+#endif
+    return ESP_OK;
+}
+
+/**
+ * @brief Convert received USB samples to the I2S layout in place, with the gain applied in the same pass
+ *
+ * @return size of the converted data in bytes
+*/
+size_t audio_convert(void *data, size_t size, uint8_t slot_bytes) {
+#if CONFIG_AUDIO_SOFT_VOLUME
+    if(mGainSeqApplied != mGainSeq) {
+        int32_t target[PCM_CHANNELS] = {mGainTarget[0], mGainTarget[1]};
+        mGainSeqApplied = mGainSeq;
+        pcm_gain_ramp_to(&mGain, target);
+    }
+#endif
+
+    size_t frames = size / (slot_bytes * PCM_CHANNELS);
+    if(slot_bytes == 2) {
+        size = pcm_convert_s16(&mGain, AUDIO_METER, data, frames);
+    } else if(mStreamConfig.bits_per_sample == 24) {
+        size = pcm_convert_s32_to_s24(&mGain, AUDIO_METER, data, frames);
+    } else {
+        size = pcm_convert_s32(&mGain, AUDIO_METER, data, frames);
+    }
+    audio_meter_update();
+    return size;
+}
+
+static esp_err_t audio_i2s_write(const void *data, size_t size, size_t *written, uint32_t wait_ms)
+{
+    TRACE(WRITE_BEGIN, size, 0);
+    PROFILE_BEGIN(write_start);
+    esp_err_t ret = i2s_channel_write(mHandleTx, data, size, written, wait_ms);
+    PROFILE_END(PROFILE_STAGE_I2S_WRITE, write_start);
+    TRACE(WRITE_END, *written, ret);
+    // What the DMA buffers took is what plays, frames dropped later never count
+    audio_silence_update(data, *written);
+    verify_update(data, *written);
+    mBytesWritten += *written;
+    mPendingPhase = (mPendingPhase + *written) % mBytesPerFrame;
+    return ret;
+}
+
+/**
+ * @brief Write the data left over from earlier packets
+ *
+ * @return ESP_OK once nothing is pending, ESP_ERR_TIMEOUT if the DMA buffers are still full
+*/
+static esp_err_t audio_write_pending(uint32_t wait_ms)
+{
+    if(mPendingBytes == 0) return ESP_OK;
+    size_t written = 0;
+    esp_err_t ret = audio_i2s_write(mPending, mPendingBytes, &written, wait_ms);
+    mPendingBytes -= written;
+    if(mPendingBytes) memmove(mPending, mPending + written, mPendingBytes);
+    return ret;
 }
 
-esp_err_t audio_write(size_t size, void * data) {
-    size_t bytes_written;
-    ESP_RETURN_ON_ERROR(i2s_channel_write(mHandleTx, data, size, &bytes_written, portMAX_DELAY), TAG, "i2s channel write failed");
-    if (bytes_written != size) {
-        ESP_LOGW(TAG, "Failed to write all data to i2s channel");
-        return ESP_FAIL;
+/**
+ * @brief Apply the overrun policy to a packet queued behind the pending data
+ *
+ * @return size of the packet left to queue, whole frames
+*/
+static size_t audio_admit(void *data, size_t size)
+{
+    const uint32_t frame_bytes = mBytesPerFrame;
+    if(mPendingBytes + size <= mPendingLimit) return size;
+
+    size_t excess = mPendingBytes + size - mPendingLimit;
+    excess += (frame_bytes - excess % frame_bytes) % frame_bytes;
+    mOverruns++;
+
+    if(mOverrunPolicy == AUDIO_OVERRUN_DROP_OLDEST) {
+        // Whole frames after the one the I2S channel is in the middle of
+        size_t head = (frame_bytes - mPendingPhase) % frame_bytes;
+        size_t oldest = (mPendingBytes - head) / frame_bytes * frame_bytes;
+        if(oldest > excess) oldest = excess;
+        memmove(mPending + head, mPending + head + oldest, mPendingBytes - head - oldest);
+        mPendingBytes -= oldest;
+        mDroppedBytes += oldest;
+        latency_discard(oldest);
+        excess -= oldest;
+    } else if(mOverrunPolicy == AUDIO_OVERRUN_STRETCH) {
+        size_t frames = size / frame_bytes;
+        size_t remove = excess / frame_bytes;
+        if(remove > frames / AUDIO_STRETCH_RATIO) remove = frames / AUDIO_STRETCH_RATIO;
+        size_t left = pcm_shorten(data, frames, frame_bytes / PCM_CHANNELS, remove);
+        mStretchedFrames += frames - left;
+        size = left * frame_bytes;
+        excess = excess > (frames - left) * frame_bytes ? excess - (frames - left) * frame_bytes : 0;
     }
+
+    // The end of the packet, for drop-newest and whatever the other policies could not absorb
+    if(excess > size) excess = size;
+    mDroppedBytes += excess;
+    return size - excess;
+}
+
+/**
+ * @brief Queue converted data to the I2S channel, waiting at most wait_ms for room
+ *
+ * Data that does not fit within the wait is kept and written ahead of the next call.
+ * When the kept data would exceed one DMA buffer and a little slack, the overrun
+ * policy gives up frames and counts them, the caller never waits longer.
+*/
+esp_err_t audio_write(size_t size, void * data, uint32_t wait_ms) {
+    // Both writes together wait at most wait_ms, the pending data takes it
+    uint32_t packet_wait = mPendingBytes && wait_ms != AUDIO_WAIT_FOREVER ? 0 : wait_ms;
+    esp_err_t ret = audio_write_pending(wait_ms);
+    size = audio_admit(data, size);
+    latency_queue(size);
+
+    size_t written = 0;
+    if(ret == ESP_OK) ret = audio_i2s_write(data, size, &written, packet_wait);
+    memcpy(mPending + mPendingBytes, (uint8_t *)data + written, size - written);
+    mPendingBytes += size - written;
+
+    if(ret == ESP_ERR_TIMEOUT) return ESP_OK;
+    ESP_RETURN_ON_ERROR(ret, TAG, "i2s channel write failed");
     return ESP_OK;
 }
 
+/**
+ * @brief Convert and write a packet in the USB slot layout, the audio path after the USB read
+*/
+esp_err_t audio_play(void *data, size_t size, uint8_t slot_bytes, uint32_t wait_ms) {
+    mPlaying = true;
+    PROFILE_BEGIN(convert_start);
+    size = audio_convert(data, size, slot_bytes);
+    PROFILE_END(PROFILE_STAGE_CONVERT, convert_start);
+    esp_err_t ret = audio_write(size, data, wait_ms);
+    mPlaying = false;
+    return ret;
+}
+
 esp_err_t audio_stop() {
-    return i2s_channel_disable(mHandleTx);
+    xSemaphoreTake(mPowerLock, portMAX_DELAY);
+    esp_err_t ret = audio_disable_i2s();
+    TRACE(STREAM_STOP, 0, 0);
+    profile_dump();
+    latency_stop();
+    verify_stop();
+    uint32_t dropped = mDroppedBytes - mStreamDroppedBytes;
+    if(dropped) {
+        ESP_LOGW(TAG, "Overruns, %lu bytes dropped by the %s policy", dropped, OVERRUN_POLICY_NAMES[mOverrunPolicy]);
+    }
+    ret |= power_stream_stop();
+    mSilentBytes = 0;
+    mSilenceRequested = false;
+    ret |= audio_silence_apply(false);
+    if(mPowerState == AUDIO_POWER_STREAMING) {
+        mPowerState = AUDIO_POWER_IDLE;
+        TRACE(POWER, AUDIO_POWER_STREAMING, AUDIO_POWER_IDLE);
+        audio_arm_idle_timer();
+    }
+    xSemaphoreGive(mPowerLock);
+    return ret;
 }
 
 esp_err_t audio_start(audio_stream_config_t *config) {
-    if(!mI2sInitialized) {
-        ESP_RETURN_ON_ERROR(init_i2s_driver(config), TAG, "init i2s driver failed");
-        mI2sInitialized = true;
-    } else {
-        i2s_std_clk_config_t clk_cfg = {
-            .sample_rate_hz = config->sample_rate_hz,
-            .clk_src = I2S_CLK_SRC_DEFAULT,
-            .mclk_multiple = AUDIO_MCLK_MULTIPLE,
-        };
-        i2s_std_slot_config_t slot_cfg = {
-            .data_bit_width = config->bits_per_sample,
-            .slot_bit_width = config->bits_per_sample,
-            .slot_mode = I2S_SLOT_MODE_STEREO,
-            .slot_mask = I2S_STD_SLOT_BOTH,
-            .ws_width = config->bits_per_sample,
-            .ws_pol = false,
-            .bit_shift = true
-        };
+    esp_err_t ret = ESP_OK;
+    int64_t start = esp_timer_get_time();
+
+    // The writers share the audio core, one preempted in a packet finishes it before the
+    // channel and the pending data are reset. It has already seen that it no longer owns them.
+    while(mPlaying) vTaskDelay(1);
+
+    xSemaphoreTake(mPowerLock, portMAX_DELAY);
+    esp_timer_stop(mIdleTimer);
+    audio_power_state_t from = mPowerState;
+
+    ESP_GOTO_ON_ERROR(power_stream_start(config->sample_rate_hz, config->bits_per_sample), out, TAG, "raise cpu frequency failed");
+    ESP_GOTO_ON_ERROR(audio_power_wake(), out, TAG, "wake from standby failed");
+    ESP_GOTO_ON_ERROR(audio_disable_i2s(), out, TAG, "i2s channel disable failed");
+    ESP_GOTO_ON_ERROR(audio_configure_i2s(config), out, TAG, "configure i2s failed");
+    mBytesPerFrame = audio_dma_frame_bytes(config);
+    mBytesWritten = mBytesSent = mUnderrunBytes = 0;
+    // One DMA buffer
+    mPendingBytes = mPendingPhase = 0;
+    mPendingLimit = mDmaFrameNum * mBytesPerFrame + AUDIO_PENDING_SLACK * AUDIO_PACKET_MAX;
+    if(mPendingLimit > AUDIO_PENDING_SIZE) mPendingLimit = AUDIO_PENDING_SIZE;
+    mStreamDroppedBytes = mDroppedBytes;
+    ESP_GOTO_ON_ERROR(i2s_channel_enable(mHandleTx), out, TAG, "i2s channel enable failed");
+    mI2sEnabled = true;
+    mPowerState = AUDIO_POWER_STREAMING;
+    TRACE(POWER, from, AUDIO_POWER_STREAMING);
+    mStreamConfig = *config;
+    TRACE(STREAM_START, config->sample_rate_hz, config->bits_per_sample);
+    profile_set_format(config->sample_rate_hz, config->bits_per_sample);
+
+    // Bytes of packed PCM per second handed to audio_write()
+    uint32_t bytes_per_frame = audio_dma_frame_bytes(config);
+    uint32_t bytes_per_second = config->sample_rate_hz * bytes_per_frame;
+    mSilenceThresholdBytes = (uint64_t)CONFIG_AUDIO_SILENCE_TIMEOUT_MS * bytes_per_second / 1000;
+    mSilentBytes = 0;
+    latency_start(bytes_per_second, mDmaFrameNum * bytes_per_frame, mDmaDescNum);
+    verify_start(config->bits_per_sample);
+#if CONFIG_AUDIO_SOFT_VOLUME
+    // The ramp length follows the rate, the audio path only starts ramps
+    pcm_gain_set_ramp(&mGain, CONFIG_AUDIO_GAIN_RAMP_MS * config->sample_rate_hz / 1000);
+#endif
+#if CONFIG_AUDIO_LED_METER
+    pcm_meter_reset(&mMeter);
+    mMeterLevelDb = -CONFIG_AUDIO_LED_METER_RANGE_DB;
+    mMeterBrightness = UINT8_MAX;
+#endif
 
-        ESP_RETURN_ON_ERROR(i2s_channel_reconfig_std_clock(mHandleTx, &clk_cfg), TAG, "i2s channel reconfig clock failed");
-        ESP_RETURN_ON_ERROR(i2s_channel_reconfig_std_slot(mHandleTx, &slot_cfg), TAG, "i2s channel reconfig slot failed");
+out:
+    xSemaphoreGive(mPowerLock);
+
+    // A failed start already logged why, it is no transition and not measured against the budget
+    if(ret != ESP_OK) return ret;
+
+    int64_t wake_us = esp_timer_get_time() - start;
+    ESP_LOGI(TAG, "Power %s -> streaming (%lu Hz, %lu bit) in %lld us",
+            POWER_STATE_NAMES[from], config->sample_rate_hz, config->bits_per_sample, wake_us);
+    if(wake_us > CONFIG_AUDIO_WAKE_BUDGET_US) {
+        ESP_LOGW(TAG, "Wake latency %lld us exceeds budget of %d us", wake_us, CONFIG_AUDIO_WAKE_BUDGET_US);
+    }
+    return ret;
+}
+
+
+/**
+ * @brief Change the I2S DMA buffering, applied when the next stream starts
+ *
+ * @param desc_num Number of DMA buffers, 0 with frame_num 0 derives them from the stream format
+ * @param frame_num Frames per DMA buffer
+*/
+esp_err_t audio_set_dma_buffers(uint32_t desc_num, uint32_t frame_num)
+{
+    bool automatic = desc_num == 0 && frame_num == 0;
+    ESP_RETURN_ON_FALSE(automatic || (desc_num >= 2 && desc_num <= AUDIO_DMA_DESC_NUM_MAX), ESP_ERR_INVALID_ARG, TAG, "invalid buffer count %lu", desc_num);
+    // 6 bytes per frame at most, buffers of this many frames fit every format
+    ESP_RETURN_ON_FALSE(automatic || (frame_num >= AUDIO_DMA_FRAME_NUM_MIN && frame_num <= AUDIO_DMA_BUFFER_MAX / 6), ESP_ERR_INVALID_ARG, TAG, "invalid buffer frames %lu", frame_num);
+
+    xSemaphoreTake(mPowerLock, portMAX_DELAY);
+    mDmaDescNumRequested = desc_num;
+    mDmaFrameNumRequested = frame_num;
+    mDmaReconfigure = true;
+    xSemaphoreGive(mPowerLock);
+
+    if(automatic) {
+        ESP_LOGI(TAG, "DMA buffers set to %d ms of audio, applied on next stream start", CONFIG_AUDIO_DMA_LATENCY_MS);
+    } else {
+        ESP_LOGI(TAG, "DMA buffers set to %lu x %lu frames, applied on next stream start", desc_num, frame_num);
     }
-    
-    ESP_LOGD(TAG, "Starting audio stream with sample rate %lu Hz and %lu bits per sample", config->sample_rate_hz, config->bits_per_sample);
-    return i2s_channel_enable(mHandleTx);
+    return ESP_OK;
+}
+
+/**
+ * @brief Choose what is given up when the host sends faster than the I2S channel plays
+*/
+esp_err_t audio_set_overrun_policy(audio_overrun_policy_t policy)
+{
+    ESP_RETURN_ON_FALSE(policy < AUDIO_OVERRUN_MAX, ESP_ERR_INVALID_ARG, TAG, "invalid overrun policy %d", policy);
+    mOverrunPolicy = policy;
+    ESP_LOGI(TAG, "Overrun policy %s", OVERRUN_POLICY_NAMES[policy]);
+    return ESP_OK;
+}
+
+const char *audio_overrun_policy_name(audio_overrun_policy_t policy)
+{
+    return policy < AUDIO_OVERRUN_MAX ? OVERRUN_POLICY_NAMES[policy] : NULL;
 }
 
+void audio_get_stats(audio_stats_t *stats)
+{
+    stats->underruns = mUnderruns;
+    stats->overruns = mOverruns;
+    stats->concealed_frames = mConcealedFrames;
+    stats->dropped_bytes = mDroppedBytes;
+    stats->stretched_frames = mStretchedFrames;
+    stats->buffer_size = mDmaDescNum * mDmaFrameNum * mBytesPerFrame;
+    stats->buffer_fill = 0;
+
+    if(mI2sEnabled) {
+        // Written data is played after the buffers queued at start, and one more buffer per underrun
+        uint32_t lead = stats->buffer_size + mUnderrunBytes;
+        uint32_t sent = mBytesSent;
+        uint32_t played = sent > lead ? sent - lead : 0;
+        uint32_t written = mBytesWritten;
+        stats->buffer_fill = written > played ? written - played : 0;
+        if(stats->buffer_fill > stats->buffer_size) stats->buffer_fill = stats->buffer_size;
+    }
+}
 
 /**
  * @brief Set the volume of the audio output in dB (min: -95.5dB, max: 32dB)
+ *
+ * @param channel 0 for master, 1 and 2 for left and right (software volume only)
 */
-esp_err_t audio_set_volume(float gain_db) {
-    return es8156_codec_set_voice_volume(gain_db * 2 + 191);
+esp_err_t audio_set_volume(int channel, float gain_db) {
+    ESP_RETURN_ON_FALSE(channel >= 0 && channel <= PCM_CHANNELS, ESP_ERR_INVALID_ARG, TAG, "invalid channel %d", channel);
+#if CONFIG_AUDIO_SOFT_VOLUME
+    mSoftVolumeDb[channel] = gain_db;
+    audio_soft_gain_update();
+    return ESP_OK;
+#else
+    if(channel != 0) return ESP_ERR_NOT_SUPPORTED;
+    return audio_set_codec_volume(gain_db);
+#endif
 }
 
 /**
  * @brief Set the mute state of the audio output
 */
 esp_err_t audio_set_mute(int channel, bool enable) {
-    return es8156_codec_set_voice_mute(channel, enable);
-}
\ No newline at end of file
+#if CONFIG_AUDIO_SOFT_VOLUME
+    if(channel == 0) {
+        mSoftMuted = enable;
+        audio_soft_gain_update();
+        return ESP_OK;
+    }
+#endif
+
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake(mPowerLock, portMAX_DELAY);
+    if(channel == 0) {
+        mMuted = enable;
+    }
+    bool hold_mute = false;
+#if CONFIG_AUDIO_SILENCE_ACTION_MUTE
+    // Keep the silence mute in place, it is released with the cached state
+    hold_mute = mSilenced && channel == 0;
+#endif
+    if(!hold_mute) {
+        ret = es8156_codec_set_voice_mute(channel, enable);
+    }
+    xSemaphoreGive(mPowerLock);
+    return ret;
+}
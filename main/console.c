@@ -0,0 +1,395 @@
+#include "console.h"
+
+#if CONFIG_AUDIO_CONSOLE
+
+#include "tusb.h"
+#include "audio.h"
+#include "latency.h"
+#include "stats.h"
+#include "events.h"
+#include "tasks.h"
+#include "reactor.h"
+#include "profile.h"
+#include "siggen.h"
+#include "verify.h"
+#include "es8156.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "console";
+
+/**
+ * The audio path runs in the TinyUSB task. The shell runs below it and on the other core,
+ * so it can never preempt it. It shares the I2C bus mutex with volume changes, whose
+ * priority inheritance bounds any delay of the USB task to one register transfer.
+*/
+_Static_assert(CONFIG_AUDIO_CONSOLE_PRIORITY < CONFIG_TINYUSB_TASK_PRIORITY, "console must run below the TinyUSB task");
+#define CONSOLE_CORE            TASK_CORE_CONTROL
+
+#define CONSOLE_LINE_MAX        64
+#define CONSOLE_ARGS_MAX        8
+#define CONSOLE_WRITE_TIMEOUT   pdMS_TO_TICKS(100)
+
+// Flash stress, a blob rewritten in its own namespace so NVS keeps erasing pages
+#define CONSOLE_FLASH_NAMESPACE "stress"
+#define CONSOLE_FLASH_BLOB      1024
+
+typedef struct {
+    const char *name;
+    const char *help;
+    void (*handler)(int argc, char **argv);
+} console_cmd_t;
+
+#define CONSOLE_STACK_SIZE      3072
+
+static TaskHandle_t mTask = NULL;
+static StaticTask_t mTaskBuf;
+static StackType_t mStack[CONSOLE_STACK_SIZE];
+
+/**
+ * @brief Write to the CDC interface, output is dropped when the host does not read it
+*/
+static void console_write(const char *data, size_t len)
+{
+    TickType_t start = xTaskGetTickCount();
+    while(len && tud_cdc_connected()) {
+        uint32_t n = tud_cdc_write(data, len);
+        data += n;
+        len -= n;
+        if(len) {
+            tud_cdc_write_flush();
+            if(xTaskGetTickCount() - start > CONSOLE_WRITE_TIMEOUT) return;
+            vTaskDelay(1);
+        }
+    }
+}
+
+static void console_printf(const char *fmt, ...)
+{
+    char buf[128];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if(len > 0) console_write(buf, len < sizeof(buf) ? len : sizeof(buf) - 1);
+}
+
+static void cmd_help(int argc, char **argv);
+
+static void cmd_stats(int argc, char **argv)
+{
+    stats_report_t r;
+    audio_stats_t audio;
+    stats_get_report(&r);
+    audio_get_stats(&audio);
+    console_printf("uptime        %lu ms\r\n", r.uptime_ms);
+    console_printf("iso packets   %lu\r\n", r.iso_packets);
+    console_printf("underruns     %lu\r\n", r.underruns);
+    console_printf("overruns      %lu, %lu bytes dropped, %lu frames stretched\r\n", r.overruns, audio.dropped_bytes, audio.stretched_frames);
+    console_printf("concealed     %lu frames\r\n", r.concealed_frames);
+    console_printf("i2c errors    %lu\r\n", r.i2c_errors);
+    console_printf("buffer        %lu / %lu bytes\r\n", r.buffer_fill, r.buffer_size);
+    console_printf("heap          %lu free, %lu min\r\n", r.heap_free, r.heap_min_free);
+    console_printf("alerts        %lu stack, %lu cpu\r\n", r.stack_alerts, r.cpu_alerts);
+}
+
+static void cmd_events(int argc, char **argv)
+{
+    events_stats_t s;
+    events_get_stats(&s);
+    console_printf("posted=%lu dispatched=%lu dropped=%lu latency avg=%lu max=%lu us\r\n",
+            s.posted, s.dispatched, s.dropped, s.latency_avg_us, s.latency_max_us);
+}
+
+static void cmd_latency(int argc, char **argv)
+{
+#if CONFIG_AUDIO_LATENCY
+    latency_summary_t s;
+    latency_get_summary(&s);
+    console_printf("n=%lu min=%lu avg=%lu p50<=%lu p99<=%lu max=%lu us, %lu underruns\r\n",
+            s.count, s.min_us, s.avg_us, s.p50_us, s.p99_us, s.max_us, s.underruns);
+#endif
+    console_printf("reported %lu us\r\n", latency_get_us());
+}
+
+static void cmd_tasks(int argc, char **argv)
+{
+    stats_tasks_report_t r;
+    console_printf("%-8s %4s %4s %6s\r\n", "name", "cpu%", "prio", "stack");
+    uint8_t first = 0;
+    do {
+        stats_get_tasks_report(first, &r);
+        for(int i = 0; i < STATS_TASKS_PER_REPORT && first + i < r.total; i++) {
+            const stats_task_entry_t *t = &r.tasks[i];
+            bool low_stack = CONFIG_AUDIO_STATS_STACK_MARGIN && t->stack_free < CONFIG_AUDIO_STATS_STACK_MARGIN;
+            console_printf("%-8.*s %4u %4u %6u%s\r\n", STATS_TASK_NAME_LEN, t->name, t->cpu_percent, t->priority, t->stack_free,
+                    low_stack ? " low" : "");
+        }
+        first += STATS_TASKS_PER_REPORT;
+    } while(first < r.total);
+}
+
+static void cmd_i2c(int argc, char **argv)
+{
+    if(argc < 2 || strcmp(argv[1], "dump") != 0) {
+        console_printf("usage: i2c dump\r\n");
+        return;
+    }
+
+    // Registers 0x00-0x25 hold the configuration, 0xFC-0xFF identify the chip
+    static const uint8_t ranges[][2] = {{0x00, 0x25}, {0xFC, 0xFF}};
+    for(int r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+        for(int reg = ranges[r][0]; reg <= ranges[r][1]; reg++) {
+            if(reg == ranges[r][0] || reg % 16 == 0) console_printf("%02x:", reg);
+            uint8_t value;
+            if(es8156_codec_read_reg(reg, &value) == ESP_OK) {
+                console_printf(" %02x", value);
+            } else {
+                console_printf(" --");
+            }
+            if(reg == ranges[r][1] || reg % 16 == 15) console_printf("\r\n");
+        }
+    }
+}
+
+static void cmd_set(int argc, char **argv)
+{
+    bool automatic = argc == 3 && strcmp(argv[2], "auto") == 0;
+    if((argc == 4 || automatic) && strcmp(argv[1], "buffer") == 0) {
+        esp_err_t err = automatic ? audio_set_dma_buffers(0, 0) : audio_set_dma_buffers(strtoul(argv[2], NULL, 0), strtoul(argv[3], NULL, 0));
+        if(err == ESP_OK) {
+            console_printf("ok, applied on next stream start\r\n");
+        } else {
+            console_printf("failed: %s\r\n", esp_err_to_name(err));
+        }
+        return;
+    }
+    if(argc == 3 && strcmp(argv[1], "overrun") == 0) {
+        for(int policy = 0; policy < AUDIO_OVERRUN_MAX; policy++) {
+            if(strcmp(argv[2], audio_overrun_policy_name(policy)) == 0) {
+                audio_set_overrun_policy(policy);
+                console_printf("ok\r\n");
+                return;
+            }
+        }
+    }
+    console_printf("usage: set buffer <count 2-%d> <frames 8-%d> | set buffer auto\r\n", AUDIO_DMA_DESC_NUM_MAX, AUDIO_DMA_BUFFER_MAX / 6);
+    console_printf("       set overrun drop-newest|drop-oldest|stretch\r\n");
+}
+
+static void cmd_load(int argc, char **argv)
+{
+    if(argc == 3 || (argc == 2 && strcmp(argv[1], "off") == 0)) {
+        uint32_t busy_us = argc == 3 ? strtoul(argv[1], NULL, 0) : 0;
+        uint32_t period_ms = argc == 3 ? strtoul(argv[2], NULL, 0) : 0;
+        esp_err_t err = reactor_set_load(busy_us, period_ms);
+        if(err == ESP_OK) {
+            console_printf("ok\r\n");
+        } else {
+            console_printf("failed: %s\r\n", esp_err_to_name(err));
+        }
+        return;
+    }
+    console_printf("usage: load <busy us> <period ms> | load off\r\n");
+}
+
+/**
+ * @brief Write flash continuously while a stream plays, to check the DMA buffers outlast flash operations
+*/
+static void cmd_flash(int argc, char **argv)
+{
+    static uint8_t blob[CONSOLE_FLASH_BLOB];
+    uint32_t seconds = argc == 2 ? strtoul(argv[1], NULL, 0) : 0;
+    if(seconds == 0) {
+        console_printf("usage: flash <seconds>, while streaming\r\n");
+        return;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(CONSOLE_FLASH_NAMESPACE, NVS_READWRITE, &handle);
+    if(err != ESP_OK) {
+        console_printf("failed: %s\r\n", esp_err_to_name(err));
+        return;
+    }
+
+    audio_stats_t before, after;
+    audio_get_stats(&before);
+    uint32_t writes = 0, max_us = 0;
+    int64_t end = esp_timer_get_time() + seconds * 1000000LL;
+    while(esp_timer_get_time() < end && err == ESP_OK) {
+        memset(blob, writes, sizeof(blob));
+        int64_t start = esp_timer_get_time();
+        err = nvs_set_blob(handle, "blob", blob, sizeof(blob));
+        if(err == ESP_OK) err = nvs_commit(handle);
+        uint32_t us = esp_timer_get_time() - start;
+        if(us > max_us) max_us = us;
+        writes++;
+    }
+    nvs_erase_all(handle);
+    nvs_commit(handle);
+    nvs_close(handle);
+    audio_get_stats(&after);
+
+    uint32_t underruns = after.underruns - before.underruns;
+    uint32_t overruns = after.overruns - before.overruns;
+    console_printf("%lu writes, longest %lu us, DMA buffers %lu bytes\r\n", writes, max_us, after.buffer_size);
+    console_printf("%lu underruns, %lu overruns, %lu bytes dropped: %s\r\n", underruns, overruns, after.dropped_bytes - before.dropped_bytes,
+            err != ESP_OK ? esp_err_to_name(err) : underruns || overruns ? "FAIL" : "pass");
+}
+
+#if CONFIG_AUDIO_VERIFY
+static void cmd_verify(int argc, char **argv)
+{
+    verify_summary_t s;
+    verify_get_summary(&s);
+    console_printf("%lu frames from %lu, crc %08lx\r\n", s.frames, s.first, s.crc);
+    console_printf("%lu dropped, %lu duplicated, %lu corrupted\r\n", s.dropped, s.duplicated, s.corrupted);
+}
+#endif
+
+#if CONFIG_AUDIO_SIGGEN
+static void siggen_print_profile()
+{
+    // GENERATE takes the place of the USB stages while the generator plays
+    static const profile_stage_t stages[] = {PROFILE_STAGE_GENERATE, PROFILE_STAGE_CONVERT, PROFILE_STAGE_I2S_WRITE};
+    static const char* const names[] = {"generate", "convert", "i2s write"};
+    console_printf("%-9s %8s %8s %8s %8s %8s\r\n", "cycles", "n", "min", "avg", "p99<=", "max");
+    for(int i = 0; i < sizeof(stages) / sizeof(stages[0]); i++) {
+        profile_summary_t s;
+        profile_get_summary(stages[i], &s);
+        console_printf("%-9s %8lu %8lu %8lu %8lu %8lu\r\n", names[i], s.count, s.min, s.avg, s.p99, s.max);
+    }
+}
+
+static void cmd_siggen(int argc, char **argv)
+{
+    if(argc == 1) {
+        console_printf("%s\r\n", siggen_running() ? "running" : "stopped");
+        if(siggen_running()) siggen_print_profile();
+        return;
+    }
+    if(strcmp(argv[1], "stop") == 0) {
+        if(siggen_running()) siggen_print_profile();
+        siggen_stop();
+        return;
+    }
+
+    siggen_config_t config = {
+        .signal = SIGGEN_MAX,
+        .sample_rate_hz = argc > 2 ? strtoul(argv[2], NULL, 0) : 48000,
+        .bits_per_sample = argc > 3 ? strtoul(argv[3], NULL, 0) : 24,
+    };
+    for(int i = 0; i < SIGGEN_MAX; i++) {
+        if(strcmp(argv[1], siggen_signal_name(i)) == 0) config.signal = i;
+    }
+    esp_err_t err = config.signal < SIGGEN_MAX ? siggen_start(&config) : ESP_ERR_INVALID_ARG;
+    if(err != ESP_OK) {
+        console_printf("usage: siggen [sine|sweep|noise [rate] [16|24] | stop]\r\n");
+    }
+}
+#endif
+
+static const console_cmd_t COMMANDS[] = {
+    {"help",    "list commands",                        cmd_help},
+    {"stats",   "audio path counters and heap",         cmd_stats},
+    {"latency", "host to speaker latency",              cmd_latency},
+    {"tasks",   "task load and free stack",             cmd_tasks},
+    {"events",  "device event bus counters and latency", cmd_events},
+    {"load",    "load <us> <ms>: control plane load",   cmd_load},
+    {"flash",   "flash <seconds>: write flash, stream", cmd_flash},
+    {"i2c",     "i2c dump: codec registers",            cmd_i2c},
+    {"set",     "set buffer|overrun: DMA, overrun",     cmd_set},
+#if CONFIG_AUDIO_VERIFY
+    {"verify",  "bit-perfect check of the last stream",  cmd_verify},
+#endif
+#if CONFIG_AUDIO_SIGGEN
+    {"siggen",  "siggen <signal> [rate] [bits]: test",  cmd_siggen},
+#endif
+};
+
+static void cmd_help(int argc, char **argv)
+{
+    for(int i = 0; i < sizeof(COMMANDS) / sizeof(COMMANDS[0]); i++) {
+        console_printf("%-8s %s\r\n", COMMANDS[i].name, COMMANDS[i].help);
+    }
+}
+
+static void console_execute(char *line)
+{
+    char *argv[CONSOLE_ARGS_MAX];
+    int argc = 0;
+    for(char *tok = strtok(line, " \t"); tok && argc < CONSOLE_ARGS_MAX; tok = strtok(NULL, " \t")) {
+        argv[argc++] = tok;
+    }
+    if(argc == 0) return;
+
+    for(int i = 0; i < sizeof(COMMANDS) / sizeof(COMMANDS[0]); i++) {
+        if(strcmp(argv[0], COMMANDS[i].name) == 0) {
+            COMMANDS[i].handler(argc, argv);
+            return;
+        }
+    }
+    console_printf("unknown command '%s', try help\r\n", argv[0]);
+}
+
+static void task_console(void *arg)
+{
+    char line[CONSOLE_LINE_MAX];
+    size_t len = 0;
+
+    while(1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        char c;
+        while(tud_cdc_read(&c, 1) == 1) {
+            if(c == '\r' || c == '\n') {
+                if(c == '\n' && len == 0) continue;
+                console_write("\r\n", 2);
+                line[len] = '\0';
+                console_execute(line);
+                len = 0;
+                console_write("> ", 2);
+            } else if(c == '\b' || c == 0x7f) {
+                if(len) {
+                    len--;
+                    console_write("\b \b", 3);
+                }
+            } else if(len < sizeof(line) - 1 && c >= ' ') {
+                line[len++] = c;
+                console_write(&c, 1);
+            }
+        }
+        tud_cdc_write_flush();
+    }
+}
+
+// Invoked by the TinyUSB task, hand the work over to the console task
+void tud_cdc_rx_cb(uint8_t itf)
+{
+    if(mTask) xTaskNotifyGive(mTask);
+}
+
+// Invoked when a terminal opens or closes the port
+void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts)
+{
+    if(dtr) {
+        tud_cdc_write_str("S3 Audio diagnostics, type help\r\n> ");
+        tud_cdc_write_flush();
+    }
+}
+
+esp_err_t console_init()
+{
+    mTask = xTaskCreateStaticPinnedToCore(task_console, "console", CONSOLE_STACK_SIZE, NULL, CONFIG_AUDIO_CONSOLE_PRIORITY, mStack, &mTaskBuf, CONSOLE_CORE);
+    return ESP_OK;
+}
+
+#endif
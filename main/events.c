@@ -0,0 +1,147 @@
+#include "events.h"
+#include "reactor.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "events";
+
+#define EVENTS_RING_SIZE        16
+#define EVENTS_MAX_HANDLERS     8
+_Static_assert((EVENTS_RING_SIZE & (EVENTS_RING_SIZE - 1)) == 0, "event ring size must be a power of two");
+
+/**
+ * Bounded multi-producer ring. A slot is free for position pos when its seq is pos,
+ * and holds the event of pos once seq is pos + 1. Producers claim positions with a
+ * compare and swap on mHead, so an interrupt never waits on the task it preempted.
+*/
+typedef struct {
+    uint32_t seq;
+    event_t event;
+} events_slot_t;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    events_handler_t handler;
+    void *arg;
+} events_subscriber_t;
+
+static events_slot_t mRing[EVENTS_RING_SIZE];
+static uint32_t mHead = 0;
+// Only the reactor reads
+static uint32_t mTail = 0;
+
+static events_subscriber_t mSubscribers[EVENTS_MAX_HANDLERS];
+static int mSubscriberCount = 0;
+
+static uint32_t mPosted = 0;
+static uint32_t mDropped = 0;
+// Written by the reactor only
+static uint32_t mDispatched = 0;
+static uint64_t mLatencySum = 0;
+static uint32_t mLatencyMax = 0;
+
+void events_init()
+{
+    for(int i = 0; i < EVENTS_RING_SIZE; i++) {
+        mRing[i].seq = i;
+    }
+}
+
+static bool IRAM_ATTR events_push(event_t *event)
+{
+    event->posted_us = esp_timer_get_time();
+
+    uint32_t pos = __atomic_load_n(&mHead, __ATOMIC_RELAXED);
+    events_slot_t *slot;
+    while(true) {
+        slot = &mRing[pos & (EVENTS_RING_SIZE - 1)];
+        int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if(diff == 0) {
+            if(__atomic_compare_exchange_n(&mHead, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if(diff < 0) {
+            // The reactor has not consumed this slot yet, the ring is full
+            __atomic_fetch_add(&mDropped, 1, __ATOMIC_RELAXED);
+            return false;
+        } else {
+            pos = __atomic_load_n(&mHead, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->event = *event;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&mPosted, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+bool events_post(esp_event_base_t base, int32_t id)
+{
+    event_t event = {.base = base, .id = id};
+    return events_post_event(&event);
+}
+
+bool events_post_event(event_t *event)
+{
+    if(!events_push(event)) return false;
+    reactor_wake();
+    return true;
+}
+
+bool IRAM_ATTR events_post_event_from_isr(event_t *event, BaseType_t *woken)
+{
+    if(!events_push(event)) return false;
+    reactor_wake_from_isr(woken);
+    return true;
+}
+
+esp_err_t events_subscribe(esp_event_base_t base, int32_t id, events_handler_t handler, void *arg)
+{
+    if(mSubscriberCount == EVENTS_MAX_HANDLERS) return ESP_ERR_NO_MEM;
+    mSubscribers[mSubscriberCount++] = (events_subscriber_t) {base, id, handler, arg};
+    return ESP_OK;
+}
+
+int events_dispatch()
+{
+    static uint32_t dropped = 0;
+    int count = 0;
+
+    while(true) {
+        events_slot_t *slot = &mRing[mTail & (EVENTS_RING_SIZE - 1)];
+        // A producer preempted between its claim and its publish wakes us again when it is done
+        if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != mTail + 1) break;
+        event_t event = slot->event;
+        __atomic_store_n(&slot->seq, mTail + EVENTS_RING_SIZE, __ATOMIC_RELEASE);
+        mTail++;
+
+        uint32_t latency = esp_timer_get_time() - event.posted_us;
+        mLatencySum += latency;
+        if(latency > mLatencyMax) mLatencyMax = latency;
+        mDispatched++;
+        count++;
+
+        for(int i = 0; i < mSubscriberCount; i++) {
+            const events_subscriber_t *s = &mSubscribers[i];
+            if((s->base == ESP_EVENT_ANY_BASE || s->base == event.base) && (s->id == ESP_EVENT_ANY_ID || s->id == event.id)) {
+                s->handler(&event, s->arg);
+            }
+        }
+    }
+
+    if(dropped != mDropped) {
+        dropped = mDropped;
+        ESP_LOGW(TAG, "%lu events dropped, ring full", dropped);
+    }
+    return count;
+}
+
+void events_get_stats(events_stats_t *stats)
+{
+    stats->posted = mPosted;
+    stats->dropped = mDropped;
+    stats->dispatched = mDispatched;
+    stats->latency_avg_us = mDispatched ? mLatencySum / mDispatched : 0;
+    stats->latency_max_us = mLatencyMax;
+}
+
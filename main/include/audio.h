@@ -1,3 +1,5 @@
+#pragma once
+
 #include "esp_types.h"
 #include "esp_err.h"
 
@@ -14,15 +16,49 @@
 #define AUDIO_VOLUME_RES        (0.5)
 #define AUDIO_VOLUME_DEFAULT    (-10.0)
 
+#define AUDIO_DMA_DESC_NUM_MAX  16
+#define AUDIO_DMA_BUFFER_MAX    4092    // bytes, limit of one DMA buffer
+
+// Wait of audio_play() for room in the DMA buffers, rounded down to FreeRTOS ticks by the driver
+#define AUDIO_WAIT_NONE         0           // never blocks, the USB task, the overrun policy takes the rest
+#define AUDIO_WAIT_FOREVER      UINT32_MAX  // the writes pace the caller, the test signal generator
+
+/**
+ * What audio_play() gives up when a packet does not fit behind the data still waiting
+ * for the DMA buffers, the host clock then runs faster than the I2S clock
+*/
+typedef enum {
+    AUDIO_OVERRUN_DROP_NEWEST,  // the end of the packet
+    AUDIO_OVERRUN_DROP_OLDEST,  // the oldest waiting data, latency stays bounded
+    AUDIO_OVERRUN_STRETCH,      // frames merged across the packet, then the end of it
+    AUDIO_OVERRUN_MAX,
+} audio_overrun_policy_t;
+
 typedef struct audio_stream_config {
     uint32_t sample_rate_hz;
     uint32_t bits_per_sample;
 } audio_stream_config_t;
 
+typedef struct audio_stats {
+    uint32_t underruns;         // DMA buffers sent without new data
+    uint32_t overruns;          // packets that did not fit behind the waiting data
+    uint32_t dropped_bytes;     // bytes given up by the overrun policy
+    uint32_t stretched_frames;  // frames merged away by AUDIO_OVERRUN_STRETCH
+    uint32_t concealed_frames;  // frames played as silence in place of missing data
+    uint32_t buffer_fill;       // bytes waiting in the DMA buffers
+    uint32_t buffer_size;
+} audio_stats_t;
+
 esp_err_t audio_init();
-esp_err_t audio_write(size_t size, void * data);
+size_t audio_convert(void *data, size_t size, uint8_t slot_bytes);
+esp_err_t audio_write(size_t size, void * data, uint32_t wait_ms);
+esp_err_t audio_play(void *data, size_t size, uint8_t slot_bytes, uint32_t wait_ms);
 esp_err_t audio_start(audio_stream_config_t *config);
 esp_err_t audio_stop();
+void audio_get_stats(audio_stats_t *stats);
+esp_err_t audio_set_dma_buffers(uint32_t desc_num, uint32_t frame_num);
+esp_err_t audio_set_overrun_policy(audio_overrun_policy_t policy);
+const char *audio_overrun_policy_name(audio_overrun_policy_t policy);
 
-esp_err_t audio_set_volume(float gain_db);
+esp_err_t audio_set_volume(int channel, float gain_db);
 esp_err_t audio_set_mute(int channel, bool enable);
\ No newline at end of file
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#if CONFIG_AUDIO_CONSOLE
+
+/**
+ * @brief Start the diagnostics shell on the CDC-ACM interface
+*/
+esp_err_t console_init();
+
+#else
+
+static inline esp_err_t console_init() { return ESP_OK; }
+
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_event.h"
+#include "freertos/FreeRTOS.h"
+#include "audio.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Device state events, USB_EVENT and BUTTON_EVENT of global.h
+ *
+ * Posting copies the event into a fixed ring and wakes the reactor, it never blocks,
+ * never allocates and is safe from interrupts and from both cores. A full ring drops
+ * the event and counts it. Handlers run on the reactor task in posting order.
+*/
+typedef struct event {
+    esp_event_base_t base;
+    int32_t id;
+    int64_t posted_us;          // set by the post, handlers see how late they run
+    union {
+        uint8_t buttons;                // BUTTON_EVENT, bit 0 left and bit 1 right pressed
+        audio_stream_config_t stream;   // USB_EVENT_STREAM_START
+    } data;
+} event_t;
+
+typedef void (*events_handler_t)(const event_t *event, void *arg);
+
+typedef struct events_stats {
+    uint32_t posted;
+    uint32_t dropped;           // posts that found the ring full
+    uint32_t dispatched;
+    uint32_t latency_avg_us;    // from the post to the first handler
+    uint32_t latency_max_us;
+} events_stats_t;
+
+/**
+ * @brief Reset the ring, called by reactor_init()
+*/
+void events_init();
+
+/**
+ * @brief Subscribe to a base, ESP_EVENT_ANY_BASE or ESP_EVENT_ANY_ID match everything
+ *
+ * The table is fixed and not locked, subscribe during init before events are posted.
+*/
+esp_err_t events_subscribe(esp_event_base_t base, int32_t id, events_handler_t handler, void *arg);
+
+/**
+ * @brief Post an event without payload
+*/
+bool events_post(esp_event_base_t base, int32_t id);
+
+/**
+ * @brief Post an event, posted_us is filled in
+ *
+ * @return false if the ring was full and the event dropped
+*/
+bool events_post_event(event_t *event);
+bool events_post_event_from_isr(event_t *event, BaseType_t *woken);
+
+/**
+ * @brief Run the handlers of every event in the ring, reactor task only
+ *
+ * @return number of events dispatched
+*/
+int events_dispatch();
+
+void events_get_stats(events_stats_t *stats);
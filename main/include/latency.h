@@ -0,0 +1,73 @@
+#pragma once
+
+#include "sdkconfig.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Host to speaker latency, from the SOF of the frame a packet arrived in
+ * to the I2S DMA buffer holding its last sample being sent out
+*/
+typedef struct latency_summary {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t avg_us;
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+    uint32_t underruns;         // DMA buffers sent without new data
+} latency_summary_t;
+
+/**
+ * @brief Start a stream session, resets the distribution
+ *
+ * @param bytes_per_second PCM bytes per second handed to the I2S channel
+ * @param dma_buf_bytes Size of one DMA buffer in bytes
+ * @param dma_buf_num Number of DMA buffers of the channel
+*/
+void latency_start(uint32_t bytes_per_second, size_t dma_buf_bytes, uint32_t dma_buf_num);
+
+/**
+ * @brief End the stream session and log its distribution
+*/
+void latency_stop();
+
+/**
+ * @brief Latency in us reported to the host, the median of the current or last session,
+ * or the nominal buffering when nothing has been measured
+*/
+uint32_t latency_get_us();
+
+#if CONFIG_AUDIO_LATENCY
+
+/**
+ * @brief Account a packet about to be written to the I2S channel, task context
+*/
+void latency_queue(size_t bytes);
+
+/**
+ * @brief Account queued bytes dropped before they reached the I2S channel, task context
+*/
+void latency_discard(size_t bytes);
+
+/**
+ * @brief Account a DMA buffer sent out, from the I2S on_sent callback
+*/
+void latency_consumed(size_t bytes);
+
+/**
+ * @brief Account a DMA buffer sent without new data, from the I2S on_send_q_ovf callback
+*/
+void latency_underrun(size_t bytes);
+
+/**
+ * @brief Summarize the current or last session
+*/
+void latency_get_summary(latency_summary_t *summary);
+
+#else
+
+static inline void latency_queue(size_t bytes) {}
+static inline void latency_discard(size_t bytes) {}
+
+#endif
@@ -8,4 +8,12 @@ esp_err_t led_init();
 void led_on();
 void led_off();
 void led_blink(uint16_t interval, uint16_t duration);
-void led_fade(uint16_t interval, uint16_t duration);
\ No newline at end of file
+void led_fade(uint16_t interval, uint16_t duration);
+void led_pulse(uint16_t interval, uint16_t duration);
+
+/**
+ * @brief Fade to a steady brightness in percent, for displays updated continuously
+ *
+ * @param duration fade time in ms, a new level interrupts the fade in progress
+*/
+void led_level(uint8_t brightness, uint16_t duration);
\ No newline at end of file
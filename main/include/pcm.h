@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PCM_CHANNELS        2
+
+// Gains are Q31, unity is the largest representable value and is treated as pass-through
+#define PCM_GAIN_UNITY      INT32_MAX
+#define PCM_GAIN_MUTE       0
+
+typedef enum {
+    PCM_RAMP_LINEAR,        // constant step per frame
+    PCM_RAMP_EXPONENTIAL,   // one-pole approach to the target, settled at the end of the ramp
+} pcm_ramp_shape_t;
+
+/**
+ * Per-channel gain stage with per-frame ramping, all channels ramp over the same frames
+*/
+typedef struct pcm_gain {
+    int32_t gain[PCM_CHANNELS];     // current gain
+    int32_t target[PCM_CHANNELS];   // gain at the end of the ramp
+    int32_t step[PCM_CHANNELS];     // linear: increment per frame, exponential: pole coefficient
+    uint32_t remaining;             // frames left in the ramp
+    uint32_t frames;                // length of the next ramp, see pcm_gain_set_ramp()
+    int32_t pole;                   // exponential pole coefficient for that length
+    pcm_ramp_shape_t shape;
+} pcm_gain_t;
+
+/**
+ * Level meter accumulated by the conversion kernels, on the samples before the gain
+*/
+typedef struct pcm_meter {
+    uint32_t peak;          // largest magnitude, left-justified to 32 bits
+    uint64_t energy;        // sum of the squared top 16 bits of every sample
+    uint32_t samples;
+} pcm_meter_t;
+
+/**
+ * @brief Check whether a PCM buffer contains only digital silence
+ *
+ * OR-reduces the buffer a word at a time, works for any sample format since
+ * silence is all-zero bytes in signed PCM.
+*/
+bool pcm_is_silent(const void *data, size_t size);
+
+/**
+ * @brief Convert an attenuation in dB to a Q31 gain, clamped to unity
+*/
+int32_t pcm_gain_from_db(float gain_db);
+
+/**
+ * @brief Set the gains without a ramp, later targets are applied at once until pcm_gain_set_ramp()
+*/
+void pcm_gain_init(pcm_gain_t *gain, int32_t value, pcm_ramp_shape_t shape);
+
+/**
+ * @brief Set the number of frames of later ramps, 0 applies targets at once
+ *
+ * The exponential pole is computed here, so ramps start without libm in the audio path.
+*/
+void pcm_gain_set_ramp(pcm_gain_t *gain, uint32_t frames);
+
+/**
+ * @brief Start a ramp from the current gains to target over the frames set by pcm_gain_set_ramp()
+ *
+ * A ramp in progress is restarted from wherever it currently is, so targets can
+ * change at any time without a step in the gain.
+*/
+void pcm_gain_ramp_to(pcm_gain_t *gain, const int32_t target[PCM_CHANNELS]);
+
+void pcm_meter_reset(pcm_meter_t *meter);
+
+/**
+ * @brief Conversion kernels from USB to I2S layout with the gain fused in, in place
+ *
+ * Each sample is loaded, scaled and stored once. Channels at unity gain outside of
+ * a ramp are passed through bit-exact. With a meter the level is accumulated from
+ * the loaded samples in the same pass, pass-through then still reads the buffer.
+ *
+ * @param meter accumulates peak and energy, NULL to skip metering
+ * @return size of the converted data in bytes
+*/
+size_t pcm_convert_s16(pcm_gain_t *gain, pcm_meter_t *meter, int16_t *samples, size_t frames);
+size_t pcm_convert_s32(pcm_gain_t *gain, pcm_meter_t *meter, int32_t *samples, size_t frames);
+
+/**
+ * @brief Same as above for left-justified 24-bit samples in 32-bit slots, packed to 3 bytes each
+*/
+size_t pcm_convert_s32_to_s24(pcm_gain_t *gain, pcm_meter_t *meter, void *data, size_t frames);
+
+/**
+ * @brief Shorten converted I2S data by merging neighbouring frames, in place
+ *
+ * Each removed frame replaces a pair by its average, pairs are spread evenly over the
+ * buffer. Removing a frame in a few hundred is not audible, unlike a dropped packet.
+ *
+ * @param sample_bytes Bytes per sample, 2 to 4, little-endian
+ * @param remove Frames to remove, nothing is removed if there are less than 2 frames per pair
+ * @return number of frames left
+*/
+size_t pcm_shorten(void *data, size_t frames, uint8_t sample_bytes, size_t remove);
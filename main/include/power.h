@@ -0,0 +1,33 @@
+#pragma once
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include <stdint.h>
+
+#if CONFIG_AUDIO_PM
+
+/**
+ * @brief Configure dynamic frequency scaling and hold the USB bus locks
+ *
+ * The OTG controller keeps the APB clock at its maximum and light sleep off while the
+ * bus is active. The CPU only runs at full speed while a stream is open.
+*/
+esp_err_t power_init();
+
+/**
+ * @brief Raise the CPU frequency for a stream, scaled by its data rate
+*/
+esp_err_t power_stream_start(uint32_t sample_rate_hz, uint32_t bits_per_sample);
+
+/**
+ * @brief Let the CPU scale down again
+*/
+esp_err_t power_stream_stop();
+
+#else
+
+static inline esp_err_t power_init() { return ESP_OK; }
+static inline esp_err_t power_stream_start(uint32_t sample_rate_hz, uint32_t bits_per_sample) { return ESP_OK; }
+static inline esp_err_t power_stream_stop() { return ESP_OK; }
+
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "sdkconfig.h"
+#include <stdint.h>
+
+/**
+ * Stages of the audio path, in the order a packet goes through them
+*/
+typedef enum {
+    PROFILE_STAGE_DCD_ISR,      // USB interrupt that copies the iso packet out of the RX FIFO
+    PROFILE_STAGE_USB_READ,     // tud_audio_read() from the class driver FIFO
+    PROFILE_STAGE_GENERATE,     // siggen synthesis, in place of the two USB stages
+    PROFILE_STAGE_CONVERT,      // audio_convert(), gain and repack
+    PROFILE_STAGE_I2S_WRITE,    // i2s_channel_write(), including the wait for DMA space
+    PROFILE_STAGE_MAX,
+} profile_stage_t;
+
+typedef struct profile_summary {
+    uint32_t count;
+    uint32_t min;
+    uint32_t avg;
+    uint32_t max;
+    uint32_t p99;               // upper bound of the histogram bucket holding the 99th percentile
+} profile_summary_t;
+
+#if CONFIG_AUDIO_PROFILE
+
+#include "esp_cpu.h"
+
+#define PROFILE_BEGIN(name)         uint32_t name = esp_cpu_get_cycle_count()
+#define PROFILE_END(stage, name)    profile_record(stage, esp_cpu_get_cycle_count() - (name))
+
+/**
+ * @brief Add a sample in CPU cycles to the histogram of the stage for the current stream format
+ *
+ * Each stage must only be recorded from one context, ISR-safe.
+*/
+void profile_record(profile_stage_t stage, uint32_t cycles);
+
+/**
+ * @brief Select the stream format following samples are accounted to
+*/
+void profile_set_format(uint32_t sample_rate_hz, uint32_t bits_per_sample);
+
+/**
+ * @brief Summarize a stage for the current stream format
+*/
+void profile_get_summary(profile_stage_t stage, profile_summary_t *summary);
+
+/**
+ * @brief Log the summaries of every stage and format that has samples
+*/
+void profile_dump();
+
+#else
+
+// Probes compile to nothing when profiling is disabled
+#define PROFILE_BEGIN(name)
+#define PROFILE_END(stage, name)
+
+static inline void profile_set_format(uint32_t sample_rate_hz, uint32_t bits_per_sample) {}
+static inline void profile_dump() {}
+
+#endif
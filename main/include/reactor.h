@@ -0,0 +1,44 @@
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Control plane of the firmware: LED, touch and the device state events run
+ * here, one call at a time, on a single task
+ *
+ * Interrupts, esp_timer callbacks and other tasks hand work over as calls, nothing
+ * in the control plane owns a task or polls. The audio path never waits on it.
+*/
+
+typedef void (*reactor_fn_t)(void *arg, uint32_t value);
+
+/**
+ * @brief Create the reactor task, before any other module posts to it
+*/
+esp_err_t reactor_init();
+
+/**
+ * @brief Queue fn(arg, value) to run on the reactor task
+ *
+ * Never blocks. A full queue drops the call and counts it, the reactor logs the drops.
+ *
+ * @return false if the call was dropped or the reactor is not running
+*/
+bool reactor_call(reactor_fn_t fn, void *arg, uint32_t value);
+bool reactor_call_from_isr(reactor_fn_t fn, void *arg, uint32_t value, BaseType_t *woken);
+
+/**
+ * @brief Synthetic control plane load, busy_us of busy waiting on the reactor every period_ms
+ *
+ * For checking the task placement of tasks.h, 0 stops it.
+*/
+esp_err_t reactor_set_load(uint32_t busy_us, uint32_t period_ms);
+
+/**
+ * @brief Wake the reactor to dispatch the events of events.h
+*/
+void reactor_wake();
+void reactor_wake_from_isr(BaseType_t *woken);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Persisted user controls, volumes are in 1/256 dB as on the UAC2 wire
+*/
+typedef struct settings {
+    int16_t volume[3];      // master, left, right
+    bool mute;
+} settings_t;
+
+/**
+ * @brief Initialize NVS and load the saved settings, must run before audio_init()
+*/
+esp_err_t settings_init();
+
+const settings_t *settings_get();
+
+/**
+ * @brief Update a setting, the write to flash is deferred until it has been stable for a while
+*/
+void settings_set_volume(int channel, int16_t volume);
+void settings_set_mute(bool mute);
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    SIGGEN_SINE,        // CONFIG_AUDIO_SIGGEN_SINE_HZ at CONFIG_AUDIO_SIGGEN_LEVEL_DBFS
+    SIGGEN_SWEEP,       // logarithmic 20 Hz to 20 kHz, repeated, at CONFIG_AUDIO_SIGGEN_LEVEL_DBFS
+    SIGGEN_NOISE,       // full-scale white noise, independent per channel
+    SIGGEN_MAX,
+} siggen_signal_t;
+
+typedef struct siggen_config {
+    siggen_signal_t signal;
+    uint32_t sample_rate_hz;
+    uint32_t bits_per_sample;   // 16 or 24
+} siggen_config_t;
+
+#if CONFIG_AUDIO_SIGGEN
+
+/**
+ * @brief Start the signal configured to play at boot, if any
+*/
+esp_err_t siggen_init();
+
+/**
+ * @brief Open a stream and feed it from the generator instead of USB
+ *
+ * Packets are 1 ms of audio in the USB slot layout and take the same conversion
+ * and I2S write as the iso OUT packets, so the per-stage profile compares directly.
+*/
+esp_err_t siggen_start(const siggen_config_t *config);
+
+/**
+ * @brief Stop the generator and close its stream, does nothing if it is not running
+*/
+esp_err_t siggen_stop();
+
+/**
+ * @brief Whether the generator owns the I2S channel, from the start of siggen_start()
+ *
+ * The USB audio callback checks it before every packet and leaves the channel alone.
+*/
+bool siggen_running();
+
+/**
+ * @brief Synthesize the next packet in the USB slot layout
+ *
+ * The output only depends on the configuration and the number of packets generated
+ * since siggen_start(), noise included.
+ *
+ * @param data Buffer of at least CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ bytes
+ * @return size of the packet in bytes
+*/
+size_t siggen_fill(void *data);
+
+/**
+ * @brief Generate one packet and play it, one iteration of the generator task
+ *
+ * Blocks while the DMA buffers are full. The host simulation calls it directly.
+*/
+esp_err_t siggen_step();
+
+const char *siggen_signal_name(siggen_signal_t signal);
+
+#else
+
+static inline esp_err_t siggen_init() { return ESP_OK; }
+static inline esp_err_t siggen_stop() { return ESP_OK; }
+static inline bool siggen_running() { return false; }
+
+#endif
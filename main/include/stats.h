@@ -0,0 +1,97 @@
+#pragma once
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include <stdint.h>
+
+/**
+ * HID feature reports on the vendor page, see TUD_HID_REPORT_DESC_STATS().
+ *
+ * Every report starts with a version and the number of valid bytes. Fields are only ever
+ * appended, the version is bumped when the meaning of an existing field changes.
+*/
+#define STATS_REPORT_VERSION    1
+#define STATS_TASKS_PER_REPORT  4
+#define STATS_TASK_NAME_LEN     8
+
+typedef struct __attribute__((packed)) stats_report {
+    uint8_t version;
+    uint8_t length;
+    uint16_t reserved;
+    uint32_t uptime_ms;
+    uint32_t iso_packets;       // packets received on the streaming endpoint
+    uint32_t underruns;
+    uint32_t overruns;
+    uint32_t concealed_frames;
+    uint32_t i2c_errors;
+    uint32_t buffer_fill;       // bytes waiting in the I2S DMA buffers
+    uint32_t buffer_size;
+    uint32_t heap_free;
+    uint32_t heap_min_free;
+    uint32_t stack_alerts;      // tasks that went below CONFIG_AUDIO_STATS_STACK_MARGIN
+    uint32_t cpu_alerts;        // times a task went over CONFIG_AUDIO_STATS_CPU_BUDGET
+    uint32_t events_dropped;    // device state events lost to a full ring, see events.h
+    uint32_t events_latency_max_us; // longest wait of an event for its handlers
+} stats_report_t;
+
+typedef struct __attribute__((packed)) stats_task_entry {
+    char name[STATS_TASK_NAME_LEN];     // truncated, not terminated when 8 characters long
+    uint8_t cpu_percent;                // load of one core over the last sampling period
+    uint8_t priority;
+    uint16_t stack_free;                // lowest amount of free stack ever, in bytes
+} stats_task_entry_t;
+
+/**
+ * Bit-perfect verification of the current or last stream, see verify.h. Only the
+ * header is valid when the firmware is built without CONFIG_AUDIO_VERIFY.
+*/
+typedef struct __attribute__((packed)) stats_verify_report {
+    uint8_t version;
+    uint8_t length;
+    uint16_t reserved;
+    uint32_t first;             // counter of the first pattern frame
+    uint32_t frames;            // pattern frames delivered to the I2S channel
+    uint32_t crc;               // CRC32 of those frames, zlib compatible
+    uint32_t dropped;
+    uint32_t duplicated;
+    uint32_t corrupted;
+} stats_verify_report_t;
+
+/**
+ * Tasks are reported in pages, the host selects the first task with a set feature report
+*/
+typedef struct __attribute__((packed)) stats_tasks_report {
+    uint8_t version;
+    uint8_t length;
+    uint8_t first;
+    uint8_t total;
+    stats_task_entry_t tasks[STATS_TASKS_PER_REPORT];
+} stats_tasks_report_t;
+
+#if CONFIG_AUDIO_STATS
+
+/**
+ * @brief Start sampling task CPU load
+*/
+esp_err_t stats_init();
+
+/**
+ * @brief Count an iso packet received, called from the audio rx path
+*/
+void stats_count_packet();
+
+void stats_get_report(stats_report_t *report);
+
+/**
+ * @brief Fill a page of the task list starting at the first task
+*/
+void stats_get_tasks_report(uint8_t first, stats_tasks_report_t *report);
+
+void stats_get_verify_report(stats_verify_report_t *report);
+
+#else
+
+static inline esp_err_t stats_init() { return ESP_OK; }
+static inline void stats_count_packet() {}
+
+#endif
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "sdkconfig.h"
+
+/**
+ * Task placement
+ *
+ * The audio path runs in the TinyUSB task, from the class driver callback to the
+ * I2S write, which never waits for room in the DMA buffers, so the audio core
+ * only holds that task and what feeds it.
+ * Everything else is control plane on the other core and can never preempt it.
+ *
+ *  task / interrupt        core        priority                        stack
+ *  ----------------------  ----------  ------------------------------  -----
+ *  USB interrupt           audio       level 1, allocated by tusb_init()
+ *  I2S DMA interrupt       audio       level 1, allocated when audio_start() creates the channel
+ *  TinyUSB (audio path)    audio       CONFIG_TINYUSB_TASK_PRIORITY    CONFIG_TINYUSB_TASK_STACK_SIZE
+ *  siggen                  audio       CONFIG_TINYUSB_TASK_PRIORITY    SIGGEN_STACK_SIZE
+ *  esp_timer               control     22, ESP-IDF                     CONFIG_ESP_TIMER_TASK_STACK_SIZE
+ *  reactor                 control     CONFIG_AUDIO_CONTROL_PRIORITY   REACTOR_STACK_SIZE
+ *  console                 control     CONFIG_AUDIO_CONSOLE_PRIORITY   CONSOLE_STACK_SIZE
+ *  main                    control     1, returns after init           CONFIG_ESP_MAIN_TASK_STACK_SIZE
+ *  touch, LEDC, GPIO       control     level 1, installed by app_main
+ *
+ * The application task stacks are static, tools/mem_budget.py counts them against
+ * CONFIG_AUDIO_RAM_BUDGET_KB with the rest of the internal RAM.
+ *
+ * Interrupts are allocated on the core that installs them. That is why tusb_init()
+ * runs in the TinyUSB task and why the main task must sit on the control core.
+ * The I2S channel is created by the first audio_start() and kept across streams,
+ * so audio_start() only runs on the audio core: USB streams start in the TinyUSB
+ * task, and siggen_start() hands the start to the siggen task, whoever calls it.
+ *
+ * The siggen task replaces the host stream and shares the TinyUSB priority, both
+ * never write to the I2S channel at the same time. esp_timer callbacks only hand
+ * work over to the reactor or the audio path, they must stay short.
+ *
+ * To check the placement, load the control core with the console "load" command
+ * while streaming and compare "latency" and "events" with and without it.
+*/
+#define TASK_CORE_AUDIO         CONFIG_AUDIO_CORE
+#define TASK_CORE_CONTROL       (1 - CONFIG_AUDIO_CORE)
+
+_Static_assert(CONFIG_AUDIO_CONTROL_PRIORITY < CONFIG_TINYUSB_TASK_PRIORITY, "control plane must run below the TinyUSB task");
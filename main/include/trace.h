@@ -0,0 +1,98 @@
+#pragma once
+
+#include "sdkconfig.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Trace events: name, kind, then the names of the two arguments.
+ * tools/trace.py parses this list to decode dumps, keep one entry per line.
+*/
+#define TRACE_EVENTS(X) \
+    X(NONE,           INSTANT,  "",           "")           \
+    X(USB_ISR,        COMPLETE, "int_status", "cycles")     \
+    X(USB_RX,         INSTANT,  "bytes",      "alt")        \
+    X(WRITE_BEGIN,    BEGIN,    "bytes",      "")           \
+    X(WRITE_END,      END,      "written",    "err")        \
+    X(I2S_SENT,       INSTANT,  "bytes",      "")           \
+    X(I2S_UNDERRUN,   INSTANT,  "bytes",      "")           \
+    X(STREAM_START,   INSTANT,  "rate",       "bits")       \
+    X(STREAM_STOP,    INSTANT,  "",           "")           \
+    X(POWER,          INSTANT,  "from",       "to")         \
+    X(SILENCE,        INSTANT,  "silenced",   "")           \
+    X(GAIN,           INSTANT,  "left",       "right")      \
+    X(HID_REPORT,     INSTANT,  "report",     "sent")
+
+#define TRACE_EVENT_ID(name, kind, arg0, arg1) TRACE_##name,
+typedef enum {
+    TRACE_EVENTS(TRACE_EVENT_ID)
+    TRACE_MAX,
+} trace_event_t;
+#undef TRACE_EVENT_ID
+
+/**
+ * Fixed size record, the dump is a trace_dump_header_t followed by these
+*/
+typedef struct trace_record {
+    uint32_t timestamp;         // esp_timer time in us, wraps after 71 minutes
+    uint8_t event;              // trace_event_t
+    uint8_t core;
+    uint16_t seq;               // low bits of the record index, detects records overwritten during a read
+    uint32_t arg0;
+    uint32_t arg1;
+} trace_record_t;
+
+#define TRACE_DUMP_MAGIC        "S3TR"
+#define TRACE_DUMP_VERSION      1
+
+typedef struct trace_dump_header {
+    char magic[4];
+    uint8_t version;
+    uint8_t record_size;
+    uint16_t cpu_mhz;           // scale of cycle count arguments
+    uint32_t count;             // records following the header
+    uint32_t lost;              // records overwritten before they could be dumped
+} trace_dump_header_t;
+
+// Commands sent by the host on the vendor OUT endpoint
+#define TRACE_CMD_DUMP          'd'
+#define TRACE_CMD_CLEAR         'c'
+
+typedef struct trace_cursor {
+    uint32_t next;
+    uint32_t end;
+} trace_cursor_t;
+
+#if CONFIG_AUDIO_TRACE
+
+#define TRACE(event, arg0, arg1)    trace_record(TRACE_##event, (arg0), (arg1))
+
+/**
+ * @brief Append a record, lock-free and safe from any task or ISR on either core
+*/
+void trace_record(trace_event_t event, uint32_t arg0, uint32_t arg1);
+
+/**
+ * @brief Start reading every record written since the last snapshot, and fill the dump header
+*/
+void trace_snapshot(trace_cursor_t *cursor, trace_dump_header_t *header);
+
+/**
+ * @brief Read the next record of a snapshot
+ *
+ * Records overwritten in the meantime are returned as TRACE_NONE.
+ *
+ * @return false when the snapshot is exhausted
+*/
+bool trace_read(trace_cursor_t *cursor, trace_record_t *record);
+
+/**
+ * @brief Drop every record written so far
+*/
+void trace_clear();
+
+#else
+
+#define TRACE(event, arg0, arg1)
+
+#endif
@@ -1,9 +1,11 @@
+#include "esp_err.h"
 #include "tusb.h"
 #include "usb_descriptors.h"
 
 // #define USB_VOLUME_MAX      AUDIO_VOLUME_MAX
 #define USB_VOLUME_MAX      16
 #define USB_VOLUME_OFFSET   0
+#define USB_CHANNEL_VOLUME_MAX  0
 
 esp_err_t usb_init();
 bool usb_report_buttons(uint16_t report);
\ No newline at end of file
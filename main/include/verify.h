@@ -0,0 +1,69 @@
+#pragma once
+
+#include "sdkconfig.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Bit-perfect verification of the PCM handed to the I2S channel
+ *
+ * The host plays a pattern where the left sample of frame n is n, wrapping at the bit
+ * depth, and the right sample is verify_pattern_check() of it. Any frame that differs
+ * from the expected one is classified, and a CRC32 of the pattern frames as delivered
+ * lets the host prove the whole stream is bit-exact, see tools/verify.py.
+ *
+ * The pattern only survives at unity gain, set the host volume to maximum.
+*/
+typedef struct verify_summary {
+    uint32_t first;             // counter of the first pattern frame of the session
+    uint32_t frames;            // pattern frames delivered, CRC covers exactly these
+    uint32_t crc;               // CRC32 of the delivered pattern frames, zlib compatible
+    uint32_t dropped;           // frames skipped in the counter sequence
+    uint32_t duplicated;        // frames the counter went back over
+    uint32_t corrupted;         // frames whose check sample does not match the counter
+} verify_summary_t;
+
+/**
+ * @brief Check sample of a pattern frame, never 0 so silence is not taken for the pattern
+ *
+ * @param counter Left sample, the frame counter masked to the bit depth
+ * @param bits Bit depth of the stream
+*/
+static inline uint32_t verify_pattern_check(uint32_t counter, uint32_t bits)
+{
+    uint32_t check = ((counter ^ 0x5a5a5a5a) * 0x9e3779b1) >> (32 - bits);
+    return check ? check : 1;
+}
+
+#if CONFIG_AUDIO_VERIFY
+
+/**
+ * @brief Start a verification session for a stream, resets the counters
+*/
+void verify_start(uint32_t bits_per_sample);
+
+/**
+ * @brief Check and checksum converted PCM as the I2S channel takes it
+ *
+ * Data the channel has not taken, or the overrun policy gave up, never gets here and
+ * shows as dropped frames. Writes may split a frame, its head is kept until the rest.
+*/
+void verify_update(const void *data, size_t size);
+
+/**
+ * @brief End the session and log its summary
+*/
+void verify_stop();
+
+/**
+ * @brief Summarize the current or last session
+*/
+void verify_get_summary(verify_summary_t *summary);
+
+#else
+
+static inline void verify_start(uint32_t bits_per_sample) {}
+static inline void verify_update(const void *data, size_t size) {}
+static inline void verify_stop() {}
+
+#endif
@@ -0,0 +1,185 @@
+#include "latency.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+
+static const char *TAG = "latency";
+
+static uint32_t mNominalUs = 0;
+
+#if CONFIG_AUDIO_LATENCY
+
+// Distribution in LATENCY_BUCKET_US steps, the last bucket collects everything above
+#define LATENCY_BUCKET_US   125
+#define LATENCY_BUCKETS     512
+
+// Packets in flight between audio_write() and the DMA, must be a power of two
+#define LATENCY_MARKS       64
+
+typedef struct {
+    uint64_t end;               // stream position right after the packet
+    int64_t sof_us;             // SOF of the frame the packet arrived in
+} latency_mark_t;
+
+static portMUX_TYPE mLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Written by the SOF interrupt
+static volatile int64_t mSofUs = 0;
+
+// Single producer (audio_write) single consumer (I2S interrupt) queue
+static latency_mark_t mMarks[LATENCY_MARKS];
+static volatile uint32_t mMarkHead = 0;
+static volatile uint32_t mMarkTail = 0;
+static uint32_t mMarksDropped = 0;
+
+// Stream positions in bytes, mWritten from the task, the rest from the I2S interrupt
+static uint64_t mWritten = 0;
+static uint64_t mSent = 0;
+static uint64_t mLead = 0;      // bytes sent before the first written byte, grows with every underrun
+
+static uint32_t mCount = 0;
+static uint32_t mMin = 0;
+static uint32_t mMax = 0;
+static uint64_t mSum = 0;
+static uint32_t mUnderruns = 0;
+static uint32_t mBuckets[LATENCY_BUCKETS];
+
+/**
+ * @brief Called by the DCD on every SOF, only its time is kept
+*/
+void IRAM_ATTR tud_dcd_sof_probe_cb(uint32_t frame_number)
+{
+    mSofUs = esp_timer_get_time();
+}
+
+void latency_queue(size_t bytes)
+{
+    mWritten += bytes;
+
+    uint32_t head = mMarkHead;
+    if(head - mMarkTail == LATENCY_MARKS) {
+        mMarksDropped++;
+        return;
+    }
+    mMarks[head % LATENCY_MARKS] = (latency_mark_t) {.end = mWritten, .sof_us = mSofUs};
+    mMarkHead = head + 1;
+}
+
+void latency_discard(size_t bytes)
+{
+    // Never sent, count them as played so the packets behind them line up with the DMA again
+    portENTER_CRITICAL(&mLock);
+    mSent += bytes;
+    portEXIT_CRITICAL(&mLock);
+}
+
+static void IRAM_ATTR latency_record(uint32_t us)
+{
+    if(mCount == 0 || us < mMin) mMin = us;
+    if(us > mMax) mMax = us;
+    mSum += us;
+    mCount++;
+    uint32_t bucket = us / LATENCY_BUCKET_US;
+    mBuckets[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+}
+
+void IRAM_ATTR latency_consumed(size_t bytes)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL_ISR(&mLock);
+    mSent += bytes;
+    uint64_t played = mSent > mLead ? mSent - mLead : 0;
+    uint32_t tail = mMarkTail;
+    while(tail != mMarkHead && mMarks[tail % LATENCY_MARKS].end <= played) {
+        latency_record(now - mMarks[tail % LATENCY_MARKS].sof_us);
+        tail++;
+    }
+    mMarkTail = tail;
+    portEXIT_CRITICAL_ISR(&mLock);
+}
+
+void IRAM_ATTR latency_underrun(size_t bytes)
+{
+    portENTER_CRITICAL_ISR(&mLock);
+    mLead += bytes;
+    mUnderruns++;
+    portEXIT_CRITICAL_ISR(&mLock);
+}
+
+static uint32_t latency_percentile(uint32_t permille)
+{
+    uint32_t rank = (uint64_t)mCount * permille / 1000, seen = 0;
+    for(int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += mBuckets[i];
+        if(seen > rank) return (i + 1) * LATENCY_BUCKET_US;
+    }
+    return mMax;
+}
+
+void latency_get_summary(latency_summary_t *summary)
+{
+    memset(summary, 0, sizeof(*summary));
+    portENTER_CRITICAL(&mLock);
+    summary->underruns = mUnderruns;
+    if(mCount) {
+        summary->count = mCount;
+        summary->min_us = mMin;
+        summary->max_us = mMax;
+        summary->avg_us = mSum / mCount;
+        summary->p50_us = latency_percentile(500);
+        summary->p99_us = latency_percentile(990);
+        if(summary->p50_us > mMax) summary->p50_us = mMax;
+        if(summary->p99_us > mMax) summary->p99_us = mMax;
+    }
+    portEXIT_CRITICAL(&mLock);
+}
+
+#endif
+
+void latency_start(uint32_t bytes_per_second, size_t dma_buf_bytes, uint32_t dma_buf_num)
+{
+    // A packet waits for the DMA ring to wrap around, plus the frame it was sent in
+    mNominalUs = (uint64_t)dma_buf_bytes * dma_buf_num * 1000000 / bytes_per_second + 1000;
+
+#if CONFIG_AUDIO_LATENCY
+    portENTER_CRITICAL(&mLock);
+    mMarkHead = mMarkTail = 0;
+    mMarksDropped = 0;
+    mWritten = mSent = 0;
+    // The first write waits for a DMA buffer to be sent, and lands behind all the others
+    mLead = dma_buf_bytes * dma_buf_num;
+    mCount = mMin = mMax = mUnderruns = 0;
+    mSum = 0;
+    memset(mBuckets, 0, sizeof(mBuckets));
+    portEXIT_CRITICAL(&mLock);
+#endif
+}
+
+void latency_stop()
+{
+#if CONFIG_AUDIO_LATENCY
+    latency_summary_t s;
+    latency_get_summary(&s);
+    if(s.count == 0) return;
+    ESP_LOGI(TAG, "Session: n=%lu min=%lu avg=%lu p50<=%lu p99<=%lu max=%lu us, nominal %lu us, %lu underruns",
+            s.count, s.min_us, s.avg_us, s.p50_us, s.p99_us, s.max_us, mNominalUs, s.underruns);
+    if(mMarksDropped) {
+        ESP_LOGW(TAG, "%lu packets not tracked, more than %d in flight", mMarksDropped, LATENCY_MARKS);
+    }
+#else
+    ESP_LOGD(TAG, "Session: nominal %lu us", mNominalUs);
+#endif
+}
+
+uint32_t latency_get_us()
+{
+#if CONFIG_AUDIO_LATENCY
+    latency_summary_t s;
+    latency_get_summary(&s);
+    if(s.count) return s.p50_us;
+#endif
+    return mNominalUs;
+}
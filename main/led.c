@@ -1,64 +1,209 @@
 #include "led.h"
+#include "reactor.h"
 #include "esp_check.h"
+#include "esp_timer.h"
+#if CONFIG_AUDIO_PM_SLEEP_IN_SUSPEND
+#include "esp_pm.h"
+#endif
 
 static const char *TAG = "led";
 
-static TaskHandle_t task_led_handle = NULL;
-
-static void led_set_brightness(uint8_t brightness)
-{
-    if(brightness > 100)
-        brightness = 100;
-    ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, 8191 * (brightness / 100.0), 0);
-}
-
-static void task_led(void *pvParameter)
-{
-    uint8_t mode = 0, lastmode = 0;
-    uint16_t interval = 0, duration = 0;
-    while(true) {
-        /**
-         * bit 0-1      mode: 0 = off, 1 = on, 2 = blink, 3 = fade
-         * bit 2-16     interval
-         * bit 17-31    duration
-        */
-        uint32_t notify_value;
-        if(xTaskNotifyWait(0, 0, &notify_value, 10 / portTICK_PERIOD_MS) == pdTRUE) {
-            mode = notify_value & 0x03;
-            interval = (notify_value >> 2) & 0x7FFF;
-            duration = (notify_value >> 17) & 0x7FFF;
-        }
-        
-        if(mode <= 1 && mode == lastmode) continue;
-
-        switch (mode)
-        {
-        case 0:
-            led_set_brightness(0);
-            break;
-        case 1:
-            led_set_brightness(100);
-            break;
-        case 2:
-            led_set_brightness(100);
-            vTaskDelay(duration / portTICK_PERIOD_MS);
-            led_set_brightness(0);
-            vTaskDelay(interval / portTICK_PERIOD_MS);
-            break;
-        case 3:
-            for(int i = 0; i < duration; i++) {
-                led_set_brightness(i * 100 / duration);
-                vTaskDelay(interval / portTICK_PERIOD_MS);
-            }
-            for(int i = duration; i > 0; i--) {
-                led_set_brightness(i * 100 / duration);
-                vTaskDelay(interval / portTICK_PERIOD_MS);
-            }
-            break;
-        }
-
-        lastmode = mode;
+#define LED_DUTY_MAX            8191    // 13 bit duty resolution
+#define LED_HOLD_MIN_MS         10      // shortest step without a fade, one tick as before
+#define LED_FADE_END_MARGIN_MS  100     // a fade end not handled by then was dropped by the reactor
+
+enum {
+    LED_MODE_OFF,
+    LED_MODE_ON,
+    LED_MODE_BLINK,
+    LED_MODE_BREATHE,
+    LED_MODE_PULSE,
+    LED_MODE_LEVEL,
+};
+
+/**
+ * @brief One step of a pattern: fade to duty in fade_ms, then hold it for hold_ms
+*/
+typedef struct {
+    uint32_t duty;
+    uint32_t fade_ms;
+    uint32_t hold_ms;
+} led_step_t;
+
+// Pattern in progress, owned by the reactor task
+static led_step_t mSteps[2];
+static int mCount = 0;
+static int mIndex = 0;
+static uint32_t mDuty = 0;
+static bool mFading = false;
+
+// Fade ends and hold timeouts of an earlier step carry an old generation and are ignored
+static volatile uint32_t mGeneration = 0;
+static uint32_t mHoldGeneration = 0;
+static esp_timer_handle_t mHoldTimer = NULL;
+static volatile uint32_t mFadeEndsDropped = 0;
+
+#if CONFIG_AUDIO_PM_SLEEP_IN_SUSPEND
+// LEDC is not clocked in light sleep, the output would freeze wherever the PWM cycle was
+static esp_pm_lock_handle_t led_pm_lock = NULL;
+static bool mPmLocked = false;
+#endif
+
+static void led_fade_end(void *arg, uint32_t generation);
+static void led_hold_end(void *arg, uint32_t generation);
+
+static bool IRAM_ATTR led_on_fade_end(const ledc_cb_param_t *param, void *user_arg)
+{
+    BaseType_t woken = pdFALSE;
+    if(param->event == LEDC_FADE_END_EVT && !reactor_call_from_isr(led_fade_end, NULL, mGeneration, &woken)) {
+        // The hold timer runs alongside every fade and ends it instead
+        mFadeEndsDropped++;
     }
+    return woken == pdTRUE;
+}
+
+static void led_hold_timer_cb(void *arg)
+{
+    // Dropped by a full queue, try again rather than stall the pattern
+    if(!reactor_call(led_hold_end, NULL, mHoldGeneration)) {
+        esp_timer_start_once(mHoldTimer, LED_HOLD_MIN_MS * 1000ULL);
+    }
+}
+
+/**
+ * @brief Expand a command into its steps, the last step loops back to the first
+ *
+ * Commands are packed as bit 0-2 mode, bit 3-16 interval, bit 17-31 duration.
+ *
+ * @return number of steps, 1 for a steady LED
+*/
+static int led_pattern(uint32_t command, led_step_t steps[2])
+{
+    uint32_t interval = (command >> 3) & 0x3FFF;
+    uint32_t duration = (command >> 17) & 0x7FFF;
+
+    switch(command & 0x07) {
+    case LED_MODE_ON:
+        steps[0] = (led_step_t){LED_DUTY_MAX, 0, 0};
+        return 1;
+    case LED_MODE_BLINK:
+        steps[0] = (led_step_t){LED_DUTY_MAX, 0, duration};
+        steps[1] = (led_step_t){0, 0, interval};
+        return 2;
+    case LED_MODE_BREATHE:
+        // The old software fade took duration steps of interval each way
+        steps[0] = (led_step_t){LED_DUTY_MAX, interval * duration, 0};
+        steps[1] = (led_step_t){0, interval * duration, 0};
+        return 2;
+    case LED_MODE_PULSE:
+        steps[0] = (led_step_t){LED_DUTY_MAX, 0, 0};
+        steps[1] = (led_step_t){0, duration, interval};
+        return 2;
+    case LED_MODE_LEVEL:
+        // Squared, so equal steps of the level look like equal steps of brightness
+        interval = interval > 100 ? 100 : interval;
+        steps[0] = (led_step_t){LED_DUTY_MAX * interval * interval / 10000, duration, 0};
+        return 1;
+    default:
+        steps[0] = (led_step_t){0, 0, 0};
+        return 1;
+    }
+}
+
+/**
+ * @brief Move the output towards duty, on the hardware fader if fade_ms is set
+ * @return true if the fade end interrupt will report completion
+*/
+static bool led_start_step(const led_step_t *step, uint32_t *duty)
+{
+    if(step->fade_ms == 0 || step->duty == *duty) {
+        ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, step->duty, 0);
+        *duty = step->duty;
+        return false;
+    }
+
+    if(ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, step->duty, step->fade_ms) != ESP_OK ||
+        ledc_fade_start(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, LEDC_FADE_NO_WAIT) != ESP_OK) {
+        ESP_LOGW(TAG, "fade to %lu failed", step->duty);
+        ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, step->duty, 0);
+        *duty = step->duty;
+        return false;
+    }
+    *duty = step->duty;
+    return true;
+}
+
+/**
+ * @brief Start the current step, then wait for its fade end or its hold time
+*/
+static void led_run_step()
+{
+    // A late fade end of the previous step must not end this one
+    mGeneration++;
+    mHoldGeneration = mGeneration;
+    mFading = led_start_step(&mSteps[mIndex], &mDuty);
+    if(mFading) {
+        // Ends the fade should its fade end be dropped
+        esp_timer_start_once(mHoldTimer, (mSteps[mIndex].fade_ms + LED_FADE_END_MARGIN_MS) * 1000ULL);
+        return;
+    }
+    if(mCount == 1) return;
+
+    // Steps without a fade hold for at least a tick so a zero length pattern cannot spin
+    uint32_t hold_ms = mSteps[mIndex].hold_ms < LED_HOLD_MIN_MS ? LED_HOLD_MIN_MS : mSteps[mIndex].hold_ms;
+    esp_timer_start_once(mHoldTimer, hold_ms * 1000ULL);
+}
+
+static void led_fade_end(void *arg, uint32_t generation)
+{
+    if(generation != mGeneration || !mFading) return;
+    esp_timer_stop(mHoldTimer);
+    mFading = false;
+    if(mCount == 1) return;
+
+    // Hold the level the fade ended on before the next step
+    if(mSteps[mIndex].hold_ms) {
+        mHoldGeneration = mGeneration;
+        esp_timer_start_once(mHoldTimer, mSteps[mIndex].hold_ms * 1000ULL);
+        return;
+    }
+    mIndex = (mIndex + 1) % mCount;
+    led_run_step();
+}
+
+static void led_hold_end(void *arg, uint32_t generation)
+{
+    if(generation != mGeneration) return;
+    if(mFading) {
+        ESP_LOGW(TAG, "fade end lost, %lu dropped", mFadeEndsDropped);
+        led_fade_end(arg, generation);
+        return;
+    }
+    mIndex = (mIndex + 1) % mCount;
+    led_run_step();
+}
+
+/**
+ * @brief Replace the pattern, runs on the reactor
+*/
+static void led_apply(void *arg, uint32_t command)
+{
+    // Stopped before the generation moves on, so a fade end raised by it is stale
+    if(mFading) ledc_fade_stop(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+    esp_timer_stop(mHoldTimer);
+    mGeneration++;
+    mFading = false;
+
+    mDuty = ledc_get_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+    mCount = led_pattern(command, mSteps);
+    mIndex = 0;
+#if CONFIG_AUDIO_PM_SLEEP_IN_SUSPEND
+    bool lit = mCount > 1 || mSteps[0].duty != 0;
+    if(lit && !mPmLocked) esp_pm_lock_acquire(led_pm_lock);
+    if(!lit && mPmLocked) esp_pm_lock_release(led_pm_lock);
+    mPmLocked = lit;
+#endif
+    led_run_step();
 }
 
 esp_err_t led_init()
@@ -90,35 +235,58 @@ esp_err_t led_init()
     ESP_RETURN_ON_ERROR(ledc_channel_config(&ledc_channel), TAG, "ledc_channel_config failed");
     ESP_RETURN_ON_ERROR(ledc_fade_func_install(0), TAG, "ledc_fade_func_install failed");
 
+#if CONFIG_AUDIO_PM_SLEEP_IN_SUSPEND
+    ESP_RETURN_ON_ERROR(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "led", &led_pm_lock), TAG, "create pm lock failed");
+#endif
+
+    const esp_timer_create_args_t hold_timer_args = {
+        .callback = led_hold_timer_cb,
+        .name = "led_hold",
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&hold_timer_args, &mHoldTimer), TAG, "create hold timer failed");
+
     // gpio_set_direction(PIN_LED, GPIO_MODE_OUTPUT);
     // gpio_set_level(PIN_LED, 1);
-    xTaskCreate(task_led, "task_led", 1024, NULL, 5, &task_led_handle);
+
+    ledc_cbs_t callbacks = {
+        .fade_cb = led_on_fade_end,
+    };
+    ESP_RETURN_ON_ERROR(ledc_cb_register(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, &callbacks, NULL), TAG, "ledc_cb_register failed");
     return ret;
 }
 
 static void led_set_state(uint8_t mode, uint16_t interval, uint16_t duration)
 {
-    if(task_led_handle == NULL) return;
-    uint32_t notify_value = (mode & 0x03) | (interval & 0x7FFF) << 2 | (duration & 0x7FFF) << 17;
-    xTaskNotify(task_led_handle, notify_value, eSetValueWithOverwrite);
+    uint32_t command = (mode & 0x07) | (interval & 0x3FFF) << 3 | (uint32_t)(duration & 0x7FFF) << 17;
+    reactor_call(led_apply, NULL, command);
 }
 
 void led_on()
 {
-    led_set_state(1, 0, 0);
+    led_set_state(LED_MODE_ON, 0, 0);
 }
 
 void led_off()
 {
-    led_set_state(0, 0, 0);
+    led_set_state(LED_MODE_OFF, 0, 0);
 }
 
 void led_blink(uint16_t interval, uint16_t duration)
 {
-    led_set_state(2, interval, duration);
+    led_set_state(LED_MODE_BLINK, interval, duration);
 }
 
 void led_fade(uint16_t interval, uint16_t duration)
 {
-    led_set_state(3, interval, duration);
-}
\ No newline at end of file
+    led_set_state(LED_MODE_BREATHE, interval, duration);
+}
+
+void led_pulse(uint16_t interval, uint16_t duration)
+{
+    led_set_state(LED_MODE_PULSE, interval, duration);
+}
+
+void led_level(uint8_t brightness, uint16_t duration)
+{
+    led_set_state(LED_MODE_LEVEL, brightness, duration);
+}
@@ -11,14 +11,28 @@
 #include "touchsensor.h"
 #include "audio.h"
 #include "usb.h"
+#include "settings.h"
+#include "stats.h"
+#include "console.h"
+#include "siggen.h"
+#include "power.h"
+#include "reactor.h"
+#include "events.h"
+#include "tasks.h"
 
 static const char *TAG = "main";
 
+// Interrupts installed below land on the core of the main task, see tasks.h
+_Static_assert(CONFIG_ESP_MAIN_TASK_AFFINITY == TASK_CORE_CONTROL, "main task must be pinned to the control core");
+
 ESP_EVENT_DEFINE_BASE(BUTTON_EVENT);
 ESP_EVENT_DEFINE_BASE(USB_EVENT);
 
-static void event_mode_change(void* handler_arg, esp_event_base_t base, int32_t id, void* event_data)
+static void event_mode_change(const event_t *event, void *arg)
 {
+    esp_event_base_t base = event->base;
+    int32_t id = event->id;
+
     if(base == USB_EVENT && id == USB_EVENT_MOUNT) {
         led_on();
     }
@@ -28,7 +42,11 @@ static void event_mode_change(void* handler_arg, esp_event_base_t base, int32_t
     }
 
     if(base == USB_EVENT && id == USB_EVENT_STREAM_START) {
+#if CONFIG_AUDIO_LED_METER
+        // 音频路径按节目电平驱动 LED
+#else
         led_fade(10, 100);
+#endif
     }
 
     if(base == USB_EVENT && id == USB_EVENT_STREAM_STOP) {
@@ -36,9 +54,9 @@ static void event_mode_change(void* handler_arg, esp_event_base_t base, int32_t
     }
 }
 
-static void event_buttons(void* handler_arg, esp_event_base_t base, int32_t id, void* event_data)
+static void event_buttons(const event_t *event, void *arg)
 {
-    uint8_t buttonState = *(uint8_t*)event_data;
+    uint8_t buttonState = event->data.buttons;
     uint16_t report = 0;
     
     // Left button
@@ -56,22 +74,37 @@ static void event_buttons(void* handler_arg, esp_event_base_t base, int32_t id,
 
 void app_main(void)
 {
-    // 初始化事件循环
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    // 初始化控制任务，LED、触摸和 USB 状态事件都在其中处理
+    ESP_ERROR_CHECK(reactor_init());
 
     // 初始化 LED
     ESP_ERROR_CHECK(led_init());
 
     // 注册事件处理函数
-    ESP_ERROR_CHECK(esp_event_handler_register(USB_EVENT, ESP_EVENT_ANY_ID, event_mode_change, NULL));
-    ESP_ERROR_CHECK(esp_event_handler_register(BUTTON_EVENT, ESP_EVENT_ANY_ID, event_buttons, NULL));
+    ESP_ERROR_CHECK(events_subscribe(USB_EVENT, ESP_EVENT_ANY_ID, event_mode_change, NULL));
+    ESP_ERROR_CHECK(events_subscribe(BUTTON_EVENT, ESP_EVENT_ANY_ID, event_buttons, NULL));
 
     // 初始化触摸
     touchsensor_init();
     
+    // 加载保存的音量设置，必须在音频模块之前
+    ESP_ERROR_CHECK(settings_init());
+
     // 初始化音频模块
     ESP_ERROR_CHECK(audio_init());
 
+    // 开始统计任务负载
+    ESP_ERROR_CHECK(stats_init());
+
+    // 诊断控制台，必须在 USB 之前
+    ESP_ERROR_CHECK(console_init());
+
+    // 电源管理，必须在 USB 之前持有总线锁
+    ESP_ERROR_CHECK(power_init());
+
     // 初始化 USB
     ESP_ERROR_CHECK(usb_init());
+
+    // 测试信号发生器，无主机时也能测试音频通路
+    ESP_ERROR_CHECK(siggen_init());
 }
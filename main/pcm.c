@@ -0,0 +1,303 @@
+#include "pcm.h"
+#include <string.h>
+#include <math.h>
+
+// Settling time of the exponential ramp in time constants, residual step is e^-7 (~0.1%)
+#define PCM_RAMP_EXP_TIME_CONSTANTS 7
+
+static inline int32_t pcm_mul_q31(int32_t sample, int32_t gain)
+{
+    return (int32_t)(((int64_t)sample * gain) >> 31);
+}
+
+/**
+ * @brief Scale one sample, unity is exact
+*/
+static inline int32_t pcm_scale_s32(int32_t sample, int32_t gain)
+{
+    return gain == PCM_GAIN_UNITY ? sample : pcm_mul_q31(sample, gain);
+}
+
+static inline int16_t pcm_scale_s16(int16_t sample, int32_t gain)
+{
+    return gain == PCM_GAIN_UNITY ? sample : (sample * (gain >> 16)) >> 15;
+}
+
+static inline bool pcm_gain_is_passthrough(const pcm_gain_t *gain)
+{
+    return gain->remaining == 0 && gain->gain[0] == PCM_GAIN_UNITY && gain->gain[1] == PCM_GAIN_UNITY;
+}
+
+/**
+ * @brief Advance the ramp by one frame, if there is one
+*/
+static inline void pcm_gain_next(pcm_gain_t *gain)
+{
+    if(gain->remaining == 0) return;
+
+    if(--gain->remaining == 0) {
+        for(int ch = 0; ch < PCM_CHANNELS; ch++) {
+            gain->gain[ch] = gain->target[ch];
+        }
+    } else if(gain->shape == PCM_RAMP_LINEAR) {
+        for(int ch = 0; ch < PCM_CHANNELS; ch++) {
+            gain->gain[ch] += gain->step[ch];
+        }
+    } else {
+        for(int ch = 0; ch < PCM_CHANNELS; ch++) {
+            gain->gain[ch] += pcm_mul_q31(gain->target[ch] - gain->gain[ch], gain->step[ch]);
+        }
+    }
+}
+
+/**
+ * @brief Accumulate one left-justified sample into the level
+*/
+static inline void pcm_meter_sample(int32_t sample, uint32_t *peak, uint64_t *energy)
+{
+    // One's complement magnitude, INT32_MIN cannot overflow
+    uint32_t magnitude = sample ^ (sample >> 31);
+    if(magnitude > *peak) *peak = magnitude;
+    int32_t high = sample >> 16;
+    *energy += (uint32_t)(high * high);
+}
+
+/**
+ * @brief Merge the level of one call, the kernels keep theirs in registers
+*/
+static inline void pcm_meter_commit(pcm_meter_t *meter, uint32_t peak, uint64_t energy, size_t frames)
+{
+    if(peak > meter->peak) meter->peak = peak;
+    meter->energy += energy;
+    meter->samples += frames * PCM_CHANNELS;
+}
+
+bool pcm_is_silent(const void *data, size_t size)
+{
+    const uint8_t *p = data;
+    uint32_t acc = 0;
+
+    // Head bytes until the pointer is word aligned
+    while(size && ((uintptr_t)p & 3)) {
+        acc |= *p++;
+        size--;
+    }
+    if(acc) return false;
+
+    // 16 bytes per iteration, bail out on the first non-zero block
+    const uint32_t *w = (const uint32_t *)p;
+    for(; size >= 16; size -= 16, w += 4) {
+        if(w[0] | w[1] | w[2] | w[3]) return false;
+    }
+    for(; size >= 4; size -= 4) {
+        acc |= *w++;
+    }
+
+    p = (const uint8_t *)w;
+    while(size--) {
+        acc |= *p++;
+    }
+    return acc == 0;
+}
+
+int32_t pcm_gain_from_db(float gain_db)
+{
+    if(gain_db >= 0) return PCM_GAIN_UNITY;
+    if(gain_db <= -140) return PCM_GAIN_MUTE;
+    return (int32_t)(powf(10.f, gain_db / 20.f) * (float)PCM_GAIN_UNITY);
+}
+
+void pcm_gain_init(pcm_gain_t *gain, int32_t value, pcm_ramp_shape_t shape)
+{
+    for(int ch = 0; ch < PCM_CHANNELS; ch++) {
+        gain->gain[ch] = value;
+        gain->target[ch] = value;
+        gain->step[ch] = 0;
+    }
+    gain->remaining = 0;
+    gain->frames = 0;
+    gain->pole = 0;
+    gain->shape = shape;
+}
+
+void pcm_gain_set_ramp(pcm_gain_t *gain, uint32_t frames)
+{
+    gain->frames = frames;
+    gain->pole = frames ? (int32_t)((1.f - expf(-(float)PCM_RAMP_EXP_TIME_CONSTANTS / frames)) * (float)PCM_GAIN_UNITY) : 0;
+}
+
+void pcm_meter_reset(pcm_meter_t *meter)
+{
+    meter->peak = 0;
+    meter->energy = 0;
+    meter->samples = 0;
+}
+
+void pcm_gain_ramp_to(pcm_gain_t *gain, const int32_t target[PCM_CHANNELS])
+{
+    const uint32_t frames = gain->frames;
+    bool settled = true;
+    for(int ch = 0; ch < PCM_CHANNELS; ch++) {
+        gain->target[ch] = target[ch];
+        settled &= target[ch] == gain->gain[ch];
+    }
+
+    if(frames == 0 || settled) {
+        for(int ch = 0; ch < PCM_CHANNELS; ch++) {
+            gain->gain[ch] = target[ch];
+        }
+        gain->remaining = 0;
+        return;
+    }
+
+    gain->remaining = frames;
+    for(int ch = 0; ch < PCM_CHANNELS; ch++) {
+        if(gain->shape == PCM_RAMP_LINEAR) {
+            gain->step[ch] = (int32_t)(((int64_t)target[ch] - gain->gain[ch]) / (int64_t)frames);
+        } else {
+            gain->step[ch] = gain->pole;
+        }
+    }
+}
+
+size_t pcm_convert_s16(pcm_gain_t *gain, pcm_meter_t *meter, int16_t *samples, size_t frames)
+{
+    size_t size = frames * PCM_CHANNELS * sizeof(*samples);
+    bool passthrough = pcm_gain_is_passthrough(gain);
+    if(passthrough && !meter) return size;
+
+    uint32_t peak = 0;
+    uint64_t energy = 0;
+    for(size_t n = frames; n; n--, samples += 2) {
+        int16_t s0 = samples[0], s1 = samples[1];
+        if(meter) {
+            pcm_meter_sample(s0 * 65536, &peak, &energy);
+            pcm_meter_sample(s1 * 65536, &peak, &energy);
+        }
+        if(!passthrough) {
+            pcm_gain_next(gain);
+            samples[0] = pcm_scale_s16(s0, gain->gain[0]);
+            samples[1] = pcm_scale_s16(s1, gain->gain[1]);
+        }
+    }
+    if(meter) pcm_meter_commit(meter, peak, energy, frames);
+    return size;
+}
+
+size_t pcm_convert_s32(pcm_gain_t *gain, pcm_meter_t *meter, int32_t *samples, size_t frames)
+{
+    size_t size = frames * PCM_CHANNELS * sizeof(*samples);
+    bool passthrough = pcm_gain_is_passthrough(gain);
+    if(passthrough && !meter) return size;
+
+    uint32_t peak = 0;
+    uint64_t energy = 0;
+    for(size_t n = frames; n; n--, samples += 2) {
+        int32_t s0 = samples[0], s1 = samples[1];
+        if(meter) {
+            pcm_meter_sample(s0, &peak, &energy);
+            pcm_meter_sample(s1, &peak, &energy);
+        }
+        if(!passthrough) {
+            pcm_gain_next(gain);
+            samples[0] = pcm_scale_s32(s0, gain->gain[0]);
+            samples[1] = pcm_scale_s32(s1, gain->gain[1]);
+        }
+    }
+    if(meter) pcm_meter_commit(meter, peak, energy, frames);
+    return size;
+}
+
+size_t pcm_convert_s32_to_s24(pcm_gain_t *gain, pcm_meter_t *meter, void *data, size_t frames)
+{
+    const int32_t *src = data;
+    uint32_t *dst = data;
+    bool passthrough = pcm_gain_is_passthrough(gain);
+    uint32_t peak = 0;
+    uint64_t energy = 0;
+
+    // Two frames per iteration: 4 slots in, 3 words out. The output never overtakes the input.
+    // Little-endian, as on the ESP32-S3.
+    for(size_t n = frames / 2; n; n--, src += 4, dst += 3) {
+        int32_t s0 = src[0], s1 = src[1], s2 = src[2], s3 = src[3];
+        if(meter) {
+            pcm_meter_sample(s0, &peak, &energy);
+            pcm_meter_sample(s1, &peak, &energy);
+            pcm_meter_sample(s2, &peak, &energy);
+            pcm_meter_sample(s3, &peak, &energy);
+        }
+        if(!passthrough) {
+            pcm_gain_next(gain);
+            s0 = pcm_scale_s32(s0, gain->gain[0]);
+            s1 = pcm_scale_s32(s1, gain->gain[1]);
+            pcm_gain_next(gain);
+            s2 = pcm_scale_s32(s2, gain->gain[0]);
+            s3 = pcm_scale_s32(s3, gain->gain[1]);
+            passthrough = pcm_gain_is_passthrough(gain);
+        }
+
+        uint32_t u0 = (uint32_t)s0 >> 8, u1 = (uint32_t)s1 >> 8, u2 = (uint32_t)s2 >> 8, u3 = (uint32_t)s3 >> 8;
+        dst[0] = u0 | u1 << 24;
+        dst[1] = u1 >> 8 | u2 << 16;
+        dst[2] = u2 >> 16 | u3 << 8;
+    }
+
+    if(frames & 1) {
+        int32_t s[2] = {src[0], src[1]};
+        pcm_gain_next(gain);
+        uint8_t *out = (uint8_t *)dst;
+        for(int ch = 0; ch < PCM_CHANNELS; ch++, out += 3) {
+            if(meter) pcm_meter_sample(s[ch], &peak, &energy);
+            uint32_t u = (uint32_t)pcm_scale_s32(s[ch], gain->gain[ch]) >> 8;
+            out[0] = u;
+            out[1] = u >> 8;
+            out[2] = u >> 16;
+        }
+    }
+
+    if(meter) pcm_meter_commit(meter, peak, energy, frames);
+    return frames * PCM_CHANNELS * 3;
+}
+
+/**
+ * @brief Load a little-endian sample of 2 to 4 bytes left-justified to 32 bits
+*/
+static inline int32_t pcm_load_sample(const uint8_t *p, uint8_t sample_bytes)
+{
+    uint32_t u = 0;
+    for(int i = 0; i < sample_bytes; i++) u |= (uint32_t)p[i] << (8 * (4 - sample_bytes + i));
+    return (int32_t)u;
+}
+
+static inline void pcm_store_sample(uint8_t *p, uint8_t sample_bytes, int32_t sample)
+{
+    for(int i = 0; i < sample_bytes; i++) p[i] = (uint32_t)sample >> (8 * (4 - sample_bytes + i));
+}
+
+size_t pcm_shorten(void *data, size_t frames, uint8_t sample_bytes, size_t remove)
+{
+    if(remove == 0 || frames < 2 * remove) return frames;
+
+    uint8_t *p = data;
+    const size_t frame_bytes = sample_bytes * PCM_CHANNELS;
+    const size_t stride = frames / remove;
+    size_t out = 0, merged = 0;
+
+    for(size_t in = 0; in < frames; in++, out++) {
+        uint8_t *dst = p + out * frame_bytes;
+        const uint8_t *src = p + in * frame_bytes;
+        // One pair per stride, in its middle, so the removed frames are spread over the buffer
+        if(merged < remove && in % stride == stride / 2 && in + 1 < frames) {
+            for(int ch = 0; ch < PCM_CHANNELS; ch++) {
+                int32_t a = pcm_load_sample(src + ch * sample_bytes, sample_bytes);
+                int32_t b = pcm_load_sample(src + frame_bytes + ch * sample_bytes, sample_bytes);
+                pcm_store_sample(dst + ch * sample_bytes, sample_bytes, (a >> 1) + (b >> 1));
+            }
+            merged++;
+            in++;
+        } else if(dst != src) {
+            memmove(dst, src, frame_bytes);
+        }
+    }
+    return out;
+}
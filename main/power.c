@@ -0,0 +1,149 @@
+#include "power.h"
+
+#if CONFIG_AUDIO_PM
+
+#include "global.h"
+#include "events.h"
+#include "esp_pm.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#if CONFIG_AUDIO_PM_SLEEP_IN_SUSPEND
+#include "esp_sleep.h"
+#include "driver/gpio.h"
+#include "soc/usb_pins.h"
+#endif
+
+static const char *TAG = "power";
+
+#define POWER_MIN_CPU_MHZ       CONFIG_XTAL_FREQ
+// Up to 48 kHz 16 bit the audio path runs at the low frequency
+#define POWER_LOW_BYTES_PER_S   (48000 * 2 * 2)
+
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+#define POWER_LIGHT_SLEEP       true
+#else
+#define POWER_LIGHT_SLEEP       false
+#endif
+
+static esp_pm_lock_handle_t mBusApbLock = NULL;
+static esp_pm_lock_handle_t mBusNoSleepLock = NULL;
+static esp_pm_lock_handle_t mStreamLock = NULL;
+static portMUX_TYPE mBusMux = portMUX_INITIALIZER_UNLOCKED;
+static bool mBusLocked = false;
+static bool mStreamLocked = false;
+
+static esp_err_t power_configure(uint32_t max_freq_mhz)
+{
+    esp_pm_config_t config = {
+        .max_freq_mhz = max_freq_mhz,
+        .min_freq_mhz = POWER_MIN_CPU_MHZ,
+        .light_sleep_enable = POWER_LIGHT_SLEEP,
+    };
+    return esp_pm_configure(&config);
+}
+
+/**
+ * @brief Keep the OTG controller clocked, ISR-safe
+*/
+static void IRAM_ATTR power_bus_acquire()
+{
+    portENTER_CRITICAL_SAFE(&mBusMux);
+    if(!mBusLocked) {
+        esp_pm_lock_acquire(mBusApbLock);
+        esp_pm_lock_acquire(mBusNoSleepLock);
+        mBusLocked = true;
+    }
+    portEXIT_CRITICAL_SAFE(&mBusMux);
+}
+
+#if CONFIG_AUDIO_PM_SLEEP_IN_SUSPEND
+static void power_bus_release()
+{
+    portENTER_CRITICAL(&mBusMux);
+    if(mBusLocked) {
+        esp_pm_lock_release(mBusNoSleepLock);
+        esp_pm_lock_release(mBusApbLock);
+        mBusLocked = false;
+    }
+    portEXIT_CRITICAL(&mBusMux);
+}
+
+/**
+ * @brief Resume signalling drives D- high, take the locks back before the controller needs them
+*/
+static void IRAM_ATTR power_resume_isr(void *arg)
+{
+    gpio_intr_disable(USBPHY_DM_NUM);
+    power_bus_acquire();
+}
+
+static void power_usb_event_handler(const event_t *event, void *arg)
+{
+    int32_t id = event->id;
+    if(id == USB_EVENT_SUSPEND) {
+        ESP_ERROR_CHECK(gpio_intr_enable(USBPHY_DM_NUM));
+        power_bus_release();
+        ESP_LOGI(TAG, "Bus suspended, light sleep allowed");
+    } else if(id == USB_EVENT_RESUME || id == USB_EVENT_MOUNT) {
+        gpio_intr_disable(USBPHY_DM_NUM);
+        power_bus_acquire();
+    }
+}
+#endif
+
+esp_err_t power_init()
+{
+    ESP_RETURN_ON_ERROR(esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "usb", &mBusApbLock), TAG, "create bus lock failed");
+    ESP_RETURN_ON_ERROR(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "usb", &mBusNoSleepLock), TAG, "create bus lock failed");
+    ESP_RETURN_ON_ERROR(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "stream", &mStreamLock), TAG, "create stream lock failed");
+
+    // Enumeration needs the bus from the start
+    power_bus_acquire();
+    ESP_RETURN_ON_ERROR(power_configure(CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ), TAG, "configure pm failed");
+
+#if CONFIG_AUDIO_PM_SLEEP_IN_SUSPEND
+    // The GPIO ISR service may already be installed by another driver
+    esp_err_t ret = gpio_install_isr_service(0);
+    ESP_RETURN_ON_FALSE(ret == ESP_OK || ret == ESP_ERR_INVALID_STATE, ret, TAG, "install gpio isr service failed");
+    ESP_RETURN_ON_ERROR(gpio_set_intr_type(USBPHY_DM_NUM, GPIO_INTR_HIGH_LEVEL), TAG, "set resume interrupt failed");
+    ESP_RETURN_ON_ERROR(gpio_wakeup_enable(USBPHY_DM_NUM, GPIO_INTR_HIGH_LEVEL), TAG, "enable resume wakeup failed");
+    ESP_RETURN_ON_ERROR(esp_sleep_enable_gpio_wakeup(), TAG, "enable gpio wakeup failed");
+    ESP_RETURN_ON_ERROR(gpio_isr_handler_add(USBPHY_DM_NUM, power_resume_isr, NULL), TAG, "add resume isr failed");
+    gpio_intr_disable(USBPHY_DM_NUM);
+    ESP_RETURN_ON_ERROR(events_subscribe(USB_EVENT, ESP_EVENT_ANY_ID, power_usb_event_handler, NULL), TAG, "register usb event handler failed");
+
+    ESP_LOGI(TAG, "Light sleep in suspend");
+#endif
+
+    ESP_LOGI(TAG, "CPU %d-%d MHz, streams at %d or %d MHz", POWER_MIN_CPU_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+            CONFIG_AUDIO_PM_CPU_MHZ_LOW, CONFIG_AUDIO_PM_CPU_MHZ_HIGH);
+    return ESP_OK;
+}
+
+esp_err_t power_stream_start(uint32_t sample_rate_hz, uint32_t bits_per_sample)
+{
+    uint32_t bytes_per_second = sample_rate_hz * 2 * bits_per_sample / 8;
+    uint32_t freq_mhz = bytes_per_second <= POWER_LOW_BYTES_PER_S ? CONFIG_AUDIO_PM_CPU_MHZ_LOW : CONFIG_AUDIO_PM_CPU_MHZ_HIGH;
+
+    // The ceiling is changed first, so the lock takes the CPU straight to the stream's frequency
+    ESP_RETURN_ON_ERROR(power_configure(freq_mhz), TAG, "configure pm failed");
+    if(!mStreamLocked) {
+        ESP_RETURN_ON_ERROR(esp_pm_lock_acquire(mStreamLock), TAG, "acquire stream lock failed");
+        mStreamLocked = true;
+    }
+    ESP_LOGD(TAG, "CPU at %lu MHz for %lu Hz %lu bit", freq_mhz, sample_rate_hz, bits_per_sample);
+    return ESP_OK;
+}
+
+esp_err_t power_stream_stop()
+{
+    if(mStreamLocked) {
+        ESP_RETURN_ON_ERROR(esp_pm_lock_release(mStreamLock), TAG, "release stream lock failed");
+        mStreamLocked = false;
+    }
+    return power_configure(CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+}
+
+#endif
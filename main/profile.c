@@ -0,0 +1,115 @@
+#include "profile.h"
+
+#if CONFIG_AUDIO_PROFILE
+
+#include "esp_log.h"
+#include "esp_attr.h"
+#include <string.h>
+
+static const char *TAG = "profile";
+
+static const char* const STAGE_NAMES[PROFILE_STAGE_MAX] = {"dcd isr", "usb read", "generate", "convert", "i2s write"};
+
+// Stream formats are accounted separately, 16 and 24 bit at every sample rate of the descriptor
+static const uint32_t SAMPLE_RATES[] = {44100, 48000, 88200, 96000};
+#define PROFILE_N_RATES     (sizeof(SAMPLE_RATES) / sizeof(SAMPLE_RATES[0]))
+#define PROFILE_N_FORMATS   (PROFILE_N_RATES * 2)
+
+/**
+ * Log-linear histogram: 4 buckets per power of two (< 19% error), exact below 4 cycles.
+ * The last bucket also collects everything above 2^20 cycles.
+*/
+#define PROFILE_SUB_BITS    2
+#define PROFILE_MAX_BITS    20
+#define PROFILE_BUCKETS     ((PROFILE_MAX_BITS - 1) << PROFILE_SUB_BITS)
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t buckets[PROFILE_BUCKETS];
+} profile_stats_t;
+
+static profile_stats_t mStats[PROFILE_N_FORMATS][PROFILE_STAGE_MAX];
+static volatile int mFormat = 0;
+
+static inline int profile_bucket(uint32_t cycles)
+{
+    if(cycles < (1 << PROFILE_SUB_BITS)) return cycles;
+    int msb = 31 - __builtin_clz(cycles);
+    int bucket = ((msb - PROFILE_SUB_BITS + 1) << PROFILE_SUB_BITS) + ((cycles >> (msb - PROFILE_SUB_BITS)) & ((1 << PROFILE_SUB_BITS) - 1));
+    return bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1;
+}
+
+static uint32_t profile_bucket_upper(int bucket)
+{
+    if(bucket < (1 << PROFILE_SUB_BITS)) return bucket;
+    int shift = (bucket >> PROFILE_SUB_BITS) - 1;
+    uint32_t lower = ((1 << PROFILE_SUB_BITS) + (bucket & ((1 << PROFILE_SUB_BITS) - 1))) << shift;
+    return lower + (1 << shift) - 1;
+}
+
+void IRAM_ATTR profile_record(profile_stage_t stage, uint32_t cycles)
+{
+    profile_stats_t *stats = &mStats[mFormat][stage];
+    if(stats->count == 0 || cycles < stats->min) stats->min = cycles;
+    if(cycles > stats->max) stats->max = cycles;
+    stats->sum += cycles;
+    stats->count++;
+    stats->buckets[profile_bucket(cycles)]++;
+}
+
+void profile_set_format(uint32_t sample_rate_hz, uint32_t bits_per_sample)
+{
+    for(int i = 0; i < PROFILE_N_RATES; i++) {
+        if(SAMPLE_RATES[i] == sample_rate_hz) {
+            mFormat = i * 2 + (bits_per_sample > 16);
+            return;
+        }
+    }
+    ESP_LOGW(TAG, "Unknown sample rate %lu, accounting to %lu", sample_rate_hz, SAMPLE_RATES[0]);
+    mFormat = bits_per_sample > 16;
+}
+
+static void profile_summarize(const profile_stats_t *stats, profile_summary_t *summary)
+{
+    memset(summary, 0, sizeof(*summary));
+    if(stats->count == 0) return;
+
+    summary->count = stats->count;
+    summary->min = stats->min;
+    summary->max = stats->max;
+    summary->avg = stats->sum / stats->count;
+
+    uint32_t rank = stats->count - stats->count / 100, seen = 0;
+    for(int i = 0; i < PROFILE_BUCKETS; i++) {
+        seen += stats->buckets[i];
+        if(seen >= rank) {
+            summary->p99 = profile_bucket_upper(i);
+            break;
+        }
+    }
+    if(summary->p99 > summary->max) summary->p99 = summary->max;
+}
+
+void profile_get_summary(profile_stage_t stage, profile_summary_t *summary)
+{
+    profile_summarize(&mStats[mFormat][stage], summary);
+}
+
+void profile_dump()
+{
+    for(int format = 0; format < PROFILE_N_FORMATS; format++) {
+        for(int stage = 0; stage < PROFILE_STAGE_MAX; stage++) {
+            profile_summary_t s;
+            profile_summarize(&mStats[format][stage], &s);
+            if(s.count == 0) continue;
+            ESP_LOGI(TAG, "%5lu Hz %d bit %-9s n=%lu min=%lu avg=%lu p99<=%lu max=%lu cycles",
+                    SAMPLE_RATES[format / 2], format % 2 ? 24 : 16, STAGE_NAMES[stage],
+                    s.count, s.min, s.avg, s.p99, s.max);
+        }
+    }
+}
+
+#endif
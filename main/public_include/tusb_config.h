@@ -63,8 +63,22 @@ extern "C" {
 // Debug Level
 #define CFG_TUSB_DEBUG              CONFIG_TINYUSB_DEBUG_LEVEL
 
+// Cycle count probe around the DCD interrupt handler, implemented in usb.c
+#if CONFIG_AUDIO_PROFILE || CONFIG_AUDIO_TRACE
+#define CFG_TUD_DCD_ISR_PROBE       1
+#endif
+
+// SOF timestamps for the latency measurement, implemented in latency.c
+#if CONFIG_AUDIO_LATENCY
+#define CFG_TUD_DCD_SOF_PROBE       1
+#endif
+
 // Enabled device class driver
+#if CONFIG_AUDIO_CONSOLE
+#define CFG_TUD_CDC                 1
+#else
 #define CFG_TUD_CDC                 0
+#endif
 #define CFG_TUD_MSC                 0
 #define CFG_TUD_HID                 1
 #define CFG_TUD_MIDI                0
@@ -75,6 +89,13 @@ extern "C" {
 #define CFG_TUD_DFU_RUNTIME         0
 #define CFG_TUD_BTH                 0
 
+// Trace dump interface
+#if CONFIG_AUDIO_TRACE
+#define CFG_TUD_VENDOR              1
+#else
+#define CFG_TUD_VENDOR              0
+#endif
+
 #define CFG_TUD_AUDIO               1
 
 //--------------------------------------------------------------------
@@ -83,6 +104,22 @@ extern "C" {
 
 #define CFG_TUD_HID_EP_BUFSIZE      64
 
+//--------------------------------------------------------------------
+// CDC CLASS DRIVER CONFIGURATION
+//--------------------------------------------------------------------
+
+#define CFG_TUD_CDC_EP_BUFSIZE      64
+#define CFG_TUD_CDC_RX_BUFSIZE      64
+#define CFG_TUD_CDC_TX_BUFSIZE      512
+
+//--------------------------------------------------------------------
+// VENDOR CLASS DRIVER CONFIGURATION
+//--------------------------------------------------------------------
+
+#define CFG_TUD_VENDOR_EPSIZE       64
+#define CFG_TUD_VENDOR_RX_BUFSIZE   64
+#define CFG_TUD_VENDOR_TX_BUFSIZE   512
+
 //--------------------------------------------------------------------
 // AUDIO CLASS DRIVER CONFIGURATION
 //--------------------------------------------------------------------
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "sdkconfig.h"
+
 // Unit numbers are arbitrary selected
 #define UAC2_ENTITY_CLOCK               0x04
 // Speaker path
@@ -7,12 +9,39 @@
 #define UAC2_ENTITY_SPK_FEATURE_UNIT    0x02
 #define UAC2_ENTITY_SPK_OUTPUT_TERMINAL 0x03
 
+// Per-channel volume is only available when it is applied in the software gain stage
+#if CONFIG_AUDIO_SOFT_VOLUME
+#define UAC2_SPK_CHANNEL_CTRL           (AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_VOLUME_POS)
+#else
+#define UAC2_SPK_CHANNEL_CTRL           0
+#endif
+
+// The output terminal answers the latency control, TinyUSB has no position for it (bmControls D11..10)
+#define UAC2_OUT_TERM_CTRL_LATENCY_POS  10
+#define UAC2_SPK_OUTPUT_TERMINAL_CTRL   (AUDIO_CTRL_R << UAC2_OUT_TERM_CTRL_LATENCY_POS)
+
+// HID reports
+#define HID_REPORT_ID_BUTTONS           1
+#define HID_REPORT_ID_STATS             2
+#define HID_REPORT_ID_TASKS             3
+#define HID_REPORT_ID_VERIFY            4
+
+// Feature reports are declared at the largest size a control transfer carries, so fields can be appended
+#define HID_STATS_REPORT_LEN            (CFG_TUD_HID_EP_BUFSIZE - 1)
+
 // #define ITF_NUM_AUDIO_STREAMING_SPK -1
 enum ITF_NUMs
 {
   ITF_NUM_AUDIO_CONTROL = 0,
   ITF_NUM_AUDIO_STREAMING_SPK,
   ITF_NUM_VOLUME_CONTROL,
+#if CONFIG_AUDIO_CONSOLE
+  ITF_NUM_CONSOLE,
+  ITF_NUM_CONSOLE_DATA,
+#endif
+#if CONFIG_AUDIO_TRACE
+  ITF_NUM_TRACE,
+#endif
   ITF_NUM_TOTAL
 };
 
@@ -45,15 +74,15 @@ enum ITF_NUMs
     /* Standard AC Interface Descriptor(4.7.1) */\
     TUD_AUDIO_DESC_STD_AC(/*_itfnum*/ _itfnum_ctrl, /*_nEPs*/ 0x00, /*_stridx*/ _stridx),\
     /* Class-Specific AC Interface Header Descriptor(4.7.2) */\
-    TUD_AUDIO_DESC_CS_AC(/*_bcdADC*/ 0x0200, /*_category*/ AUDIO_FUNC_DESKTOP_SPEAKER, /*_totallen*/ TUD_AUDIO_DESC_CLK_SRC_LEN+TUD_AUDIO_DESC_FEATURE_UNIT_TWO_CHANNEL_LEN+TUD_AUDIO_DESC_INPUT_TERM_LEN+TUD_AUDIO_DESC_OUTPUT_TERM_LEN, /*_ctrl*/ AUDIO_CS_AS_INTERFACE_CTRL_LATENCY_POS),\
+    TUD_AUDIO_DESC_CS_AC(/*_bcdADC*/ 0x0200, /*_category*/ AUDIO_FUNC_DESKTOP_SPEAKER, /*_totallen*/ TUD_AUDIO_DESC_CLK_SRC_LEN+TUD_AUDIO_DESC_FEATURE_UNIT_TWO_CHANNEL_LEN+TUD_AUDIO_DESC_INPUT_TERM_LEN+TUD_AUDIO_DESC_OUTPUT_TERM_LEN, /*_ctrl*/ AUDIO_CTRL_NONE),\
     /* Clock Source Descriptor(4.7.2.1) */\
     TUD_AUDIO_DESC_CLK_SRC(/*_clkid*/ UAC2_ENTITY_CLOCK, /*_attr*/ 3, /*_ctrl*/ 7, /*_assocTerm*/ 0x00,  /*_stridx*/ 0x00),    \
     /* Input Terminal Descriptor(4.7.2.4) */\
     TUD_AUDIO_DESC_INPUT_TERM(/*_termid*/ UAC2_ENTITY_SPK_INPUT_TERMINAL, /*_termtype*/ AUDIO_TERM_TYPE_USB_STREAMING, /*_assocTerm*/ 0x00, /*_clkid*/ UAC2_ENTITY_CLOCK, /*_nchannelslogical*/ 0x02, /*_channelcfg*/ AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, /*_idxchannelnames*/ 0x00, /*_ctrl*/ 0 * (AUDIO_CTRL_R << AUDIO_IN_TERM_CTRL_CONNECTOR_POS), /*_stridx*/ 0x00),\
     /* Feature Unit Descriptor(4.7.2.8) */\
-    TUD_AUDIO_DESC_FEATURE_UNIT_TWO_CHANNEL(/*_unitid*/ UAC2_ENTITY_SPK_FEATURE_UNIT, /*_srcid*/ UAC2_ENTITY_SPK_INPUT_TERMINAL, /*_ctrlch0master*/ (AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_MUTE_POS | AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_VOLUME_POS), /*_ctrlch1*/ 0, /*_ctrlch2*/ 0, /*_stridx*/ 0x00),\
+    TUD_AUDIO_DESC_FEATURE_UNIT_TWO_CHANNEL(/*_unitid*/ UAC2_ENTITY_SPK_FEATURE_UNIT, /*_srcid*/ UAC2_ENTITY_SPK_INPUT_TERMINAL, /*_ctrlch0master*/ (AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_MUTE_POS | AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_VOLUME_POS), /*_ctrlch1*/ UAC2_SPK_CHANNEL_CTRL, /*_ctrlch2*/ UAC2_SPK_CHANNEL_CTRL, /*_stridx*/ 0x00),\
     /* Output Terminal Descriptor(4.7.2.5) */\
-    TUD_AUDIO_DESC_OUTPUT_TERM(/*_termid*/ UAC2_ENTITY_SPK_OUTPUT_TERMINAL, /*_termtype*/ AUDIO_TERM_TYPE_OUT_DESKTOP_SPEAKER, /*_assocTerm*/ 0x00, /*_srcid*/ UAC2_ENTITY_SPK_FEATURE_UNIT, /*_clkid*/ UAC2_ENTITY_CLOCK, /*_ctrl*/ 0x0000, /*_stridx*/ 0x00),\
+    TUD_AUDIO_DESC_OUTPUT_TERM(/*_termid*/ UAC2_ENTITY_SPK_OUTPUT_TERMINAL, /*_termtype*/ AUDIO_TERM_TYPE_OUT_DESKTOP_SPEAKER, /*_assocTerm*/ 0x00, /*_srcid*/ UAC2_ENTITY_SPK_FEATURE_UNIT, /*_clkid*/ UAC2_ENTITY_CLOCK, /*_ctrl*/ UAC2_SPK_OUTPUT_TERMINAL_CTRL, /*_stridx*/ 0x00),\
     \
     /* Standard AS Interface Descriptor(4.9.1) */\
     /* Interface 1, Alternate 0 - default alternate setting with 0 bandwidth */\
@@ -85,7 +114,7 @@ enum ITF_NUMs
     HID_USAGE_PAGE ( HID_USAGE_PAGE_CONSUMER     )                    ,\
     HID_USAGE      ( HID_USAGE_CONSUMER_CONTROL  )                    ,\
     HID_COLLECTION ( HID_COLLECTION_APPLICATION  )                    ,\
-      HID_REPORT_ID(1)   \
+      HID_REPORT_ID(HID_REPORT_ID_BUTTONS)   \
       HID_LOGICAL_MIN(0), \
       HID_LOGICAL_MAX(1), \
       HID_REPORT_SIZE(1), \
@@ -117,5 +146,27 @@ enum ITF_NUMs
       HID_INPUT(HID_CONSTANT | HID_ARRAY | HID_ABSOLUTE), \
     HID_COLLECTION_END
 
+// Runtime statistics as vendor page feature reports, layouts in stats.h
+#define TUD_HID_REPORT_DESC_STATS() \
+    HID_USAGE_PAGE_N ( HID_USAGE_PAGE_VENDOR, 2 )                     ,\
+    HID_USAGE        ( 0x01 )                                         ,\
+    HID_COLLECTION   ( HID_COLLECTION_APPLICATION )                   ,\
+      HID_REPORT_ID    ( HID_REPORT_ID_STATS ) \
+      HID_USAGE        ( 0x02 )                                       ,\
+      HID_LOGICAL_MIN  ( 0x00 )                                       ,\
+      HID_LOGICAL_MAX_N( 0xff, 2 )                                    ,\
+      HID_REPORT_SIZE  ( 8 )                                          ,\
+      HID_REPORT_COUNT ( HID_STATS_REPORT_LEN )                       ,\
+      HID_FEATURE      ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE )     ,\
+      HID_REPORT_ID    ( HID_REPORT_ID_TASKS ) \
+      HID_USAGE        ( 0x03 )                                       ,\
+      HID_REPORT_COUNT ( HID_STATS_REPORT_LEN )                       ,\
+      HID_FEATURE      ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE )     ,\
+      HID_REPORT_ID    ( HID_REPORT_ID_VERIFY ) \
+      HID_USAGE        ( 0x04 )                                       ,\
+      HID_REPORT_COUNT ( HID_STATS_REPORT_LEN )                       ,\
+      HID_FEATURE      ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE )     ,\
+    HID_COLLECTION_END
+
 
 void usb_descriptors_dummy();
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "reactor.h"
+#include "events.h"
+#include "tasks.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+static const char *TAG = "reactor";
+
+#define REACTOR_STACK_SIZE      4096    // NVS writes of settings.c run here
+#define REACTOR_PRIORITY        CONFIG_AUDIO_CONTROL_PRIORITY
+#define REACTOR_QUEUE_SIZE      16
+
+typedef struct {
+    reactor_fn_t fn;
+    void *arg;
+    uint32_t value;
+} reactor_item_t;
+
+static QueueHandle_t mQueue = NULL;
+static TaskHandle_t mTask = NULL;
+static StaticQueue_t mQueueBuf;
+static uint8_t mQueueStorage[REACTOR_QUEUE_SIZE * sizeof(reactor_item_t)];
+static StaticTask_t mTaskBuf;
+static StackType_t mStack[REACTOR_STACK_SIZE];
+static volatile uint32_t mDropped = 0;
+
+static esp_timer_handle_t mLoadTimer = NULL;
+static uint32_t mLoadBusyUs = 0;
+
+static void task_reactor(void *pvParameter)
+{
+    uint32_t dropped = 0;
+    reactor_item_t item;
+    while(true) {
+        // One notification per call or event posted, they are all drained below
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        bool busy;
+        do {
+            busy = events_dispatch() > 0;
+            if(xQueueReceive(mQueue, &item, 0) == pdTRUE) {
+                item.fn(item.arg, item.value);
+                busy = true;
+            }
+        } while(busy);
+
+        if(dropped != mDropped) {
+            dropped = mDropped;
+            ESP_LOGW(TAG, "%lu calls dropped, queue full", dropped);
+        }
+    }
+}
+
+bool reactor_call(reactor_fn_t fn, void *arg, uint32_t value)
+{
+    if(mTask == NULL) return false;
+    reactor_item_t item = {fn, arg, value};
+    if(xQueueSendToBack(mQueue, &item, 0) == pdTRUE) {
+        xTaskNotifyGive(mTask);
+        return true;
+    }
+    mDropped++;
+    return false;
+}
+
+bool IRAM_ATTR reactor_call_from_isr(reactor_fn_t fn, void *arg, uint32_t value, BaseType_t *woken)
+{
+    if(mTask == NULL) return false;
+    reactor_item_t item = {fn, arg, value};
+    if(xQueueSendToBackFromISR(mQueue, &item, woken) == pdTRUE) {
+        vTaskNotifyGiveFromISR(mTask, woken);
+        return true;
+    }
+    mDropped++;
+    return false;
+}
+
+void reactor_wake()
+{
+    if(mTask) xTaskNotifyGive(mTask);
+}
+
+void IRAM_ATTR reactor_wake_from_isr(BaseType_t *woken)
+{
+    if(mTask) vTaskNotifyGiveFromISR(mTask, woken);
+}
+
+static void reactor_load_burst(void *arg, uint32_t busy_us)
+{
+    esp_rom_delay_us(busy_us);
+}
+
+static void reactor_load_timer_cb(void *arg)
+{
+    reactor_call(reactor_load_burst, NULL, mLoadBusyUs);
+}
+
+esp_err_t reactor_set_load(uint32_t busy_us, uint32_t period_ms)
+{
+    ESP_RETURN_ON_FALSE(busy_us == 0 || busy_us < period_ms * 1000, ESP_ERR_INVALID_ARG, TAG, "load busier than its period");
+    if(mLoadTimer == NULL) {
+        const esp_timer_create_args_t load_timer_args = {
+            .callback = reactor_load_timer_cb,
+            .name = "reactor_load",
+        };
+        ESP_RETURN_ON_ERROR(esp_timer_create(&load_timer_args, &mLoadTimer), TAG, "create load timer failed");
+    }
+
+    esp_timer_stop(mLoadTimer);
+    mLoadBusyUs = busy_us;
+    if(busy_us == 0) return ESP_OK;
+    ESP_LOGI(TAG, "Synthetic load of %lu us every %lu ms", busy_us, period_ms);
+    return esp_timer_start_periodic(mLoadTimer, period_ms * 1000ULL);
+}
+
+esp_err_t reactor_init()
+{
+    mQueue = xQueueCreateStatic(REACTOR_QUEUE_SIZE, sizeof(reactor_item_t), mQueueStorage, &mQueueBuf);
+
+    events_init();
+
+    mTask = xTaskCreateStaticPinnedToCore(task_reactor, "reactor", REACTOR_STACK_SIZE, NULL, REACTOR_PRIORITY, mStack, &mTaskBuf, TASK_CORE_CONTROL);
+    return ESP_OK;
+}
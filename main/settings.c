@@ -0,0 +1,148 @@
+#include "settings.h"
+#include "audio.h"
+#include "reactor.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+static const char *TAG = "settings";
+
+#define SETTINGS_NAMESPACE  "settings"
+#define SETTINGS_KEY        "controls"
+#define SETTINGS_VERSION    1
+
+/**
+ * Layout in flash, bump SETTINGS_VERSION when it changes
+*/
+typedef struct {
+    uint8_t version;
+    settings_t settings;
+} settings_blob_t;
+
+static settings_t mSettings = {
+    .volume = {AUDIO_VOLUME_DEFAULT * 256, 0, 0},
+    .mute = false,
+};
+static settings_t mSaved;
+static portMUX_TYPE mLock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t mSaveTimer = NULL;
+
+static bool settings_equal(const settings_t *a, const settings_t *b)
+{
+    return memcmp(a->volume, b->volume, sizeof(a->volume)) == 0 && a->mute == b->mute;
+}
+
+/**
+ * @brief Write the settings to flash, runs on the reactor and never in the USB or audio path
+ *
+ * An NVS page erase can take hundreds of ms, the shared esp_timer task must not wait for it.
+*/
+static void settings_save(void *arg, uint32_t value)
+{
+    settings_blob_t blob = { .version = SETTINGS_VERSION };
+    portENTER_CRITICAL(&mLock);
+    blob.settings = mSettings;
+    portEXIT_CRITICAL(&mLock);
+
+    if(settings_equal(&blob.settings, &mSaved)) return;
+
+    int64_t start = esp_timer_get_time();
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(SETTINGS_NAMESPACE, NVS_READWRITE, &handle);
+    if(ret == ESP_OK) {
+        ret = nvs_set_blob(handle, SETTINGS_KEY, &blob, sizeof(blob));
+        if(ret == ESP_OK) ret = nvs_commit(handle);
+        nvs_close(handle);
+    }
+
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Save failed: %s", esp_err_to_name(ret));
+        return;
+    }
+    mSaved = blob.settings;
+    ESP_LOGI(TAG, "Saved in %lld us from task %s", esp_timer_get_time() - start, pcTaskGetName(NULL));
+}
+
+static void settings_save_timer_cb(void *arg)
+{
+    // Dropped by a full queue, try again on the next countdown
+    if(!reactor_call(settings_save, NULL, 0)) {
+        esp_timer_start_once(mSaveTimer, CONFIG_AUDIO_SETTINGS_SAVE_DELAY_MS * 1000ULL);
+    }
+}
+
+static void settings_schedule_save()
+{
+    // Restart the countdown on every change, so a slider drag ends up as a single write
+    esp_timer_stop(mSaveTimer);
+    esp_timer_start_once(mSaveTimer, CONFIG_AUDIO_SETTINGS_SAVE_DELAY_MS * 1000ULL);
+}
+
+static void settings_load()
+{
+    nvs_handle_t handle;
+    settings_blob_t blob;
+    size_t size = sizeof(blob);
+
+    if(nvs_open(SETTINGS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        ESP_LOGI(TAG, "No saved settings, using defaults");
+        return;
+    }
+    esp_err_t ret = nvs_get_blob(handle, SETTINGS_KEY, &blob, &size);
+    nvs_close(handle);
+
+    if(ret != ESP_OK || size != sizeof(blob) || blob.version != SETTINGS_VERSION) {
+        ESP_LOGW(TAG, "Saved settings unusable (%s), using defaults", esp_err_to_name(ret));
+        return;
+    }
+    mSettings = blob.settings;
+    ESP_LOGI(TAG, "Restored volume %d/%d/%d, mute %d", mSettings.volume[0], mSettings.volume[1], mSettings.volume[2], mSettings.mute);
+}
+
+esp_err_t settings_init()
+{
+    esp_err_t ret = nvs_flash_init();
+    if(ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "NVS partition needs to be erased");
+        ESP_RETURN_ON_ERROR(nvs_flash_erase(), TAG, "nvs erase failed");
+        ret = nvs_flash_init();
+    }
+    ESP_RETURN_ON_ERROR(ret, TAG, "nvs init failed");
+
+    const esp_timer_create_args_t save_timer_args = {
+        .callback = settings_save_timer_cb,
+        .name = "settings_save",
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&save_timer_args, &mSaveTimer), TAG, "create save timer failed");
+
+    settings_load();
+    mSaved = mSettings;
+    return ESP_OK;
+}
+
+const settings_t *settings_get()
+{
+    return &mSettings;
+}
+
+void settings_set_volume(int channel, int16_t volume)
+{
+    if(channel < 0 || channel >= 3) return;
+    portENTER_CRITICAL(&mLock);
+    mSettings.volume[channel] = volume;
+    portEXIT_CRITICAL(&mLock);
+    settings_schedule_save();
+}
+
+void settings_set_mute(bool mute)
+{
+    portENTER_CRITICAL(&mLock);
+    mSettings.mute = mute;
+    portEXIT_CRITICAL(&mLock);
+    settings_schedule_save();
+}
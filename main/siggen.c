@@ -0,0 +1,267 @@
+#include "siggen.h"
+
+#if CONFIG_AUDIO_SIGGEN
+
+#include "tusb.h"
+#include "audio.h"
+#include "profile.h"
+#include "tasks.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <math.h>
+
+static const char *TAG = "siggen";
+
+static const char* const SIGNAL_NAMES[SIGGEN_MAX] = {"sine", "sweep", "noise"};
+
+// Same task setup as the TinyUSB task, so the audio path is scheduled as it is for USB packets
+#define SIGGEN_CORE             TASK_CORE_AUDIO
+#define SIGGEN_STACK_SIZE       3072
+
+#define SIGGEN_SWEEP_START_HZ   20.0f
+#define SIGGEN_SWEEP_END_HZ     20000.0f
+#define SIGGEN_NOISE_SEED       0x2545f491
+
+static TaskHandle_t mTask = NULL;
+static StaticTask_t mTaskBuf;
+static StackType_t mStack[SIGGEN_STACK_SIZE];
+static SemaphoreHandle_t mStart = NULL;
+static SemaphoreHandle_t mOpened = NULL;
+static SemaphoreHandle_t mStopped = NULL;
+static StaticSemaphore_t mStartBuf;
+static StaticSemaphore_t mOpenedBuf;
+static StaticSemaphore_t mStoppedBuf;
+static esp_err_t mOpenResult = ESP_OK;
+static volatile bool mRunning = false;     // generator task loop
+static bool mActive = false;               // stream opened by siggen_start()
+static volatile bool mClaimed = false;     // the I2S channel belongs to the generator, from before the open
+
+static siggen_config_t mConfig;
+static uint8_t mSlotBytes;
+static uint32_t mFrameAcc;                 // sub-packet frames, in 1/1000 frame
+static uint32_t mPackets;
+
+// Sine and sweep oscillator, phase in turns
+static float mAmplitude;
+static float mPhase;
+static float mStep;
+static float mSweepFactor;                 // step multiplier per sample
+static uint32_t mSweepSamples;
+static uint32_t mSweepPosition;
+
+static uint32_t mNoise;
+
+const char *siggen_signal_name(siggen_signal_t signal)
+{
+    return signal < SIGGEN_MAX ? SIGNAL_NAMES[signal] : "?";
+}
+
+/**
+ * @brief xorshift32, full period and deterministic for a given seed
+*/
+static inline uint32_t siggen_noise_next()
+{
+    mNoise ^= mNoise << 13;
+    mNoise ^= mNoise >> 17;
+    mNoise ^= mNoise << 5;
+    return mNoise;
+}
+
+static inline float siggen_oscillator_next()
+{
+    float value = mAmplitude * sinf(2 * (float)M_PI * mPhase);
+    mPhase += mStep;
+    if(mPhase >= 1.0f) mPhase -= 1.0f;
+
+    if(mConfig.signal == SIGGEN_SWEEP) {
+        mStep *= mSweepFactor;
+        if(++mSweepPosition == mSweepSamples) {
+            mSweepPosition = 0;
+            mStep = SIGGEN_SWEEP_START_HZ / mConfig.sample_rate_hz;
+        }
+    }
+    return value;
+}
+
+/**
+ * @brief Store a sample left-justified in the USB slot, full scale is [-1, 1)
+*/
+static inline void siggen_store(void *data, uint32_t index, float value)
+{
+    if(mSlotBytes == 2) {
+        ((int16_t *)data)[index] = (int16_t)lrintf(value * INT16_MAX);
+    } else {
+        ((int32_t *)data)[index] = (int32_t)lrintf(value * 0x7fffff) << 8;
+    }
+}
+
+size_t siggen_fill(void *data)
+{
+    // 1 ms of audio per packet, as the host sends them
+    mFrameAcc += mConfig.sample_rate_hz;
+    uint32_t frames = mFrameAcc / 1000;
+    mFrameAcc %= 1000;
+
+    if(mConfig.signal == SIGGEN_NOISE) {
+        // Random bits are already uniform over the full scale, only keep the slot's precision
+        uint32_t mask = mSlotBytes == 2 ? 0xffff0000 : 0xffffff00;
+        for(uint32_t i = 0; i < frames * 2; i++) {
+            uint32_t value = siggen_noise_next() & mask;
+            if(mSlotBytes == 2) {
+                ((int16_t *)data)[i] = (int16_t)(value >> 16);
+            } else {
+                ((int32_t *)data)[i] = (int32_t)value;
+            }
+        }
+    } else {
+        for(uint32_t i = 0; i < frames; i++) {
+            float value = siggen_oscillator_next();
+            siggen_store(data, 2 * i, value);
+            siggen_store(data, 2 * i + 1, value);
+        }
+    }
+
+    mPackets++;
+    return frames * 2 * mSlotBytes;
+}
+
+esp_err_t siggen_step()
+{
+    static uint8_t packet[CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ] __attribute__((aligned(4)));
+
+    PROFILE_BEGIN(generate_start);
+    size_t size = siggen_fill(packet);
+    PROFILE_END(PROFILE_STAGE_GENERATE, generate_start);
+    return audio_play(packet, size, mSlotBytes, AUDIO_WAIT_FOREVER);
+}
+
+/**
+ * @brief Open the stream of mConfig
+ *
+ * The I2S driver allocates its interrupt on the core that creates the channel, and
+ * USB streams reuse the channel, so it runs on the generator task when there is one.
+*/
+static esp_err_t siggen_open()
+{
+    audio_stream_config_t stream = {
+        .sample_rate_hz = mConfig.sample_rate_hz,
+        .bits_per_sample = mConfig.bits_per_sample,
+    };
+    return audio_start(&stream);
+}
+
+static void task_siggen(void *arg)
+{
+    while(1) {
+        xSemaphoreTake(mStart, portMAX_DELAY);
+        mOpenResult = siggen_open();
+        xSemaphoreGive(mOpened);
+        if(mOpenResult != ESP_OK) continue;
+
+        while(mRunning) {
+            esp_err_t err = siggen_step();
+            if(err != ESP_OK) {
+                ESP_LOGE(TAG, "Audio path failed (%s), generator stopped", esp_err_to_name(err));
+                mRunning = false;
+            }
+        }
+        xSemaphoreGive(mStopped);
+    }
+}
+
+esp_err_t siggen_start(const siggen_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config->signal < SIGGEN_MAX, ESP_ERR_INVALID_ARG, TAG, "invalid signal %d", config->signal);
+    ESP_RETURN_ON_FALSE(config->bits_per_sample == 16 || config->bits_per_sample == 24, ESP_ERR_INVALID_ARG,
+            TAG, "invalid bits per sample %lu", config->bits_per_sample);
+    ESP_RETURN_ON_FALSE(config->sample_rate_hz == 44100 || config->sample_rate_hz == 48000 ||
+            config->sample_rate_hz == 88200 || config->sample_rate_hz == 96000, ESP_ERR_INVALID_ARG,
+            TAG, "invalid sample rate %lu", config->sample_rate_hz);
+    ESP_RETURN_ON_ERROR(siggen_stop(), TAG, "stop failed");
+
+    mConfig = *config;
+    mSlotBytes = config->bits_per_sample == 16 ? CFG_TUD_AUDIO_FUNC_1_FORMAT_1_N_BYTES_PER_SAMPLE_RX
+                                               : CFG_TUD_AUDIO_FUNC_1_FORMAT_2_N_BYTES_PER_SAMPLE_RX;
+    mFrameAcc = 0;
+    mPackets = 0;
+    mNoise = SIGGEN_NOISE_SEED;
+    mAmplitude = powf(10, CONFIG_AUDIO_SIGGEN_LEVEL_DBFS / 20.0f);
+    mPhase = 0;
+    mSweepPosition = 0;
+    if(config->signal == SIGGEN_SWEEP) {
+        // Stay clear of the anti-imaging filter at 44.1 kHz
+        float end_hz = fminf(SIGGEN_SWEEP_END_HZ, 0.45f * config->sample_rate_hz);
+        mSweepSamples = (uint64_t)CONFIG_AUDIO_SIGGEN_SWEEP_MS * config->sample_rate_hz / 1000;
+        mSweepFactor = powf(end_hz / SIGGEN_SWEEP_START_HZ, 1.0f / mSweepSamples);
+        mStep = SIGGEN_SWEEP_START_HZ / config->sample_rate_hz;
+    } else {
+        mStep = (float)CONFIG_AUDIO_SIGGEN_SINE_HZ / config->sample_rate_hz;
+    }
+
+    // The USB callback stops writing before the siggen task opens the stream
+    mClaimed = true;
+    mRunning = true;
+    esp_err_t err = ESP_OK;
+    if(mTask) {
+        xSemaphoreGive(mStart);
+        xSemaphoreTake(mOpened, portMAX_DELAY);
+        err = mOpenResult;
+    } else {
+        err = siggen_open();
+    }
+    if(err != ESP_OK) mRunning = mClaimed = false;
+    ESP_RETURN_ON_ERROR(err, TAG, "audio start failed");
+    mActive = true;
+
+    ESP_LOGI(TAG, "Playing %s at %lu Hz %lu bit", SIGNAL_NAMES[config->signal], config->sample_rate_hz, config->bits_per_sample);
+    return ESP_OK;
+}
+
+esp_err_t siggen_stop()
+{
+    if(!mActive) return ESP_OK;
+
+    // The task leaves its loop after the packet in flight, at most one DMA buffer later
+    mRunning = false;
+    if(mTask) xSemaphoreTake(mStopped, portMAX_DELAY);
+    mActive = false;
+
+    ESP_LOGI(TAG, "Stopped %s after %lu packets", SIGNAL_NAMES[mConfig.signal], mPackets);
+    esp_err_t ret = audio_stop();
+    mClaimed = false;
+    return ret;
+}
+
+bool siggen_running()
+{
+    return mClaimed;
+}
+
+esp_err_t siggen_init()
+{
+    mStart = xSemaphoreCreateBinaryStatic(&mStartBuf);
+    mOpened = xSemaphoreCreateBinaryStatic(&mOpenedBuf);
+    mStopped = xSemaphoreCreateBinaryStatic(&mStoppedBuf);
+    mTask = xTaskCreateStaticPinnedToCore(task_siggen, "siggen", SIGGEN_STACK_SIZE, NULL, CONFIG_TINYUSB_TASK_PRIORITY, mStack, &mTaskBuf, SIGGEN_CORE);
+
+#if CONFIG_AUDIO_SIGGEN_BOOT_SINE || CONFIG_AUDIO_SIGGEN_BOOT_SWEEP || CONFIG_AUDIO_SIGGEN_BOOT_NOISE
+    siggen_config_t config = {
+#if CONFIG_AUDIO_SIGGEN_BOOT_SINE
+        .signal = SIGGEN_SINE,
+#elif CONFIG_AUDIO_SIGGEN_BOOT_SWEEP
+        .signal = SIGGEN_SWEEP,
+#else
+        .signal = SIGGEN_NOISE,
+#endif
+        .sample_rate_hz = CONFIG_AUDIO_SIGGEN_BOOT_RATE,
+        .bits_per_sample = CONFIG_AUDIO_SIGGEN_BOOT_BITS,
+    };
+    ESP_RETURN_ON_ERROR(siggen_start(&config), TAG, "start boot signal failed");
+#endif
+    return ESP_OK;
+}
+
+#endif
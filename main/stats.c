@@ -0,0 +1,193 @@
+#include "stats.h"
+
+#if CONFIG_AUDIO_STATS
+
+#include "audio.h"
+#include "verify.h"
+#include "events.h"
+#include "es8156.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <stddef.h>
+
+static const char *TAG = "stats";
+
+#define STATS_MAX_TASKS     16
+
+static volatile uint32_t mIsoPackets = 0;
+static volatile uint32_t mStackAlerts = 0;
+static volatile uint32_t mCpuAlerts = 0;
+
+// Alert state per task, raised once when a threshold is crossed and rearmed when back within it
+#define STATS_ALERT_STACK   (1 << 0)
+#define STATS_ALERT_CPU     (1 << 1)
+
+// Task table refreshed by mSampleTimer, read by the USB task
+static portMUX_TYPE mLock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t mSampleTimer = NULL;
+static TaskStatus_t mStatus[STATS_MAX_TASKS];
+static uint32_t mLastRunTime[STATS_MAX_TASKS];
+static UBaseType_t mLastTaskNumber[STATS_MAX_TASKS];
+static uint8_t mLastAlerts[STATS_MAX_TASKS];
+static uint32_t mLastTotalRunTime = 0;
+static stats_task_entry_t mTasks[STATS_MAX_TASKS];
+static uint8_t mTaskCount = 0;
+
+/**
+ * @brief Index of a task in the previous sample, -1 for a task created since
+*/
+static int stats_last_index(UBaseType_t task_number)
+{
+    for(int i = 0; i < STATS_MAX_TASKS; i++) {
+        if(mLastTaskNumber[i] == task_number) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Check a task against the stack margin and CPU budget, logs the thresholds crossed
+ *
+ * @return alert state of the task for the next sample
+*/
+static uint8_t stats_check_task(const TaskStatus_t *status, const stats_task_entry_t *task, uint8_t alerts)
+{
+    bool low_stack = CONFIG_AUDIO_STATS_STACK_MARGIN && task->stack_free < CONFIG_AUDIO_STATS_STACK_MARGIN;
+    if(low_stack && !(alerts & STATS_ALERT_STACK)) {
+        mStackAlerts++;
+        ESP_LOGW(TAG, "Task %s has %u bytes of stack left, margin is %d", status->pcTaskName, task->stack_free, CONFIG_AUDIO_STATS_STACK_MARGIN);
+    }
+
+    // Idle tasks take whatever is left, they have no budget
+    bool idle = strncmp(status->pcTaskName, "IDLE", 4) == 0;
+    bool over_budget = CONFIG_AUDIO_STATS_CPU_BUDGET && !idle && task->cpu_percent > CONFIG_AUDIO_STATS_CPU_BUDGET;
+    if(over_budget && !(alerts & STATS_ALERT_CPU)) {
+        mCpuAlerts++;
+        ESP_LOGW(TAG, "Task %s used %u%% of a core, budget is %d%%", status->pcTaskName, task->cpu_percent, CONFIG_AUDIO_STATS_CPU_BUDGET);
+    }
+
+    return (low_stack ? STATS_ALERT_STACK : 0) | (over_budget ? STATS_ALERT_CPU : 0);
+}
+
+/**
+ * @brief Compute the load of every task over the last period from the FreeRTOS run time counters
+*/
+static void stats_sample_cb(void *arg)
+{
+    uint32_t total_run_time;
+    UBaseType_t count = uxTaskGetSystemState(mStatus, STATS_MAX_TASKS, &total_run_time);
+    if(count == 0) {
+        ESP_LOGW(TAG, "More than %d tasks, load not sampled", STATS_MAX_TASKS);
+        return;
+    }
+
+    uint32_t elapsed = total_run_time - mLastTotalRunTime;
+    stats_task_entry_t tasks[STATS_MAX_TASKS] = {0};
+    uint8_t alerts[STATS_MAX_TASKS] = {0};
+    for(int i = 0; i < count; i++) {
+        const TaskStatus_t *status = &mStatus[i];
+        int last = stats_last_index(status->xTaskNumber);
+        uint32_t run_time = last >= 0 ? status->ulRunTimeCounter - mLastRunTime[last] : 0;
+        strncpy(tasks[i].name, status->pcTaskName, STATS_TASK_NAME_LEN);
+        tasks[i].cpu_percent = elapsed ? (uint64_t)run_time * 100 / elapsed : 0;
+        tasks[i].priority = status->uxCurrentPriority;
+        tasks[i].stack_free = status->usStackHighWaterMark > UINT16_MAX ? UINT16_MAX : status->usStackHighWaterMark;
+        alerts[i] = stats_check_task(status, &tasks[i], last >= 0 ? mLastAlerts[last] : 0);
+    }
+
+    for(int i = 0; i < STATS_MAX_TASKS; i++) {
+        mLastTaskNumber[i] = i < count ? mStatus[i].xTaskNumber : 0;
+        mLastRunTime[i] = i < count ? mStatus[i].ulRunTimeCounter : 0;
+        mLastAlerts[i] = alerts[i];
+    }
+    mLastTotalRunTime = total_run_time;
+
+    portENTER_CRITICAL(&mLock);
+    memcpy(mTasks, tasks, sizeof(mTasks));
+    mTaskCount = count;
+    portEXIT_CRITICAL(&mLock);
+}
+
+esp_err_t stats_init()
+{
+    esp_timer_create_args_t timer_args = {
+        .callback = stats_sample_cb,
+        .name = "stats",
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&timer_args, &mSampleTimer), TAG, "create sample timer failed");
+    return esp_timer_start_periodic(mSampleTimer, CONFIG_AUDIO_STATS_PERIOD_MS * 1000);
+}
+
+void stats_count_packet()
+{
+    mIsoPackets++;
+}
+
+void stats_get_report(stats_report_t *report)
+{
+    audio_stats_t audio;
+    audio_get_stats(&audio);
+
+    memset(report, 0, sizeof(*report));
+    report->version = STATS_REPORT_VERSION;
+    report->length = sizeof(*report);
+    report->uptime_ms = esp_timer_get_time() / 1000;
+    report->iso_packets = mIsoPackets;
+    report->underruns = audio.underruns;
+    report->overruns = audio.overruns;
+    report->concealed_frames = audio.concealed_frames;
+    report->i2c_errors = es8156_get_error_count();
+    report->buffer_fill = audio.buffer_fill;
+    report->buffer_size = audio.buffer_size;
+    report->heap_free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    report->heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+    report->stack_alerts = mStackAlerts;
+    report->cpu_alerts = mCpuAlerts;
+
+    events_stats_t events;
+    events_get_stats(&events);
+    report->events_dropped = events.dropped;
+    report->events_latency_max_us = events.latency_max_us;
+}
+
+void stats_get_tasks_report(uint8_t first, stats_tasks_report_t *report)
+{
+    memset(report, 0, sizeof(*report));
+    report->version = STATS_REPORT_VERSION;
+    report->first = first;
+
+    portENTER_CRITICAL(&mLock);
+    report->total = mTaskCount;
+    int n = 0;
+    for(; n < STATS_TASKS_PER_REPORT && first + n < mTaskCount; n++) {
+        report->tasks[n] = mTasks[first + n];
+    }
+    portEXIT_CRITICAL(&mLock);
+
+    report->length = offsetof(stats_tasks_report_t, tasks) + n * sizeof(stats_task_entry_t);
+}
+
+void stats_get_verify_report(stats_verify_report_t *report)
+{
+    memset(report, 0, sizeof(*report));
+    report->version = STATS_REPORT_VERSION;
+    report->length = offsetof(stats_verify_report_t, first);
+
+#if CONFIG_AUDIO_VERIFY
+    verify_summary_t summary;
+    verify_get_summary(&summary);
+    report->length = sizeof(*report);
+    report->first = summary.first;
+    report->frames = summary.frames;
+    report->crc = summary.crc;
+    report->dropped = summary.dropped;
+    report->duplicated = summary.duplicated;
+    report->corrupted = summary.corrupted;
+#endif
+}
+
+#endif
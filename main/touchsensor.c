@@ -1,10 +1,15 @@
 #include "touchsensor.h"
 #include "global.h"
+#include "reactor.h"
+#include "events.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "freertos/queue.h"
 #include "driver/touch_sensor.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#if CONFIG_AUDIO_PM_SLEEP_IN_SUSPEND
+#include "esp_sleep.h"
+#endif
 
 static const char *TAG = "touch";
 
@@ -28,17 +33,20 @@ static const float button_threshold[TOUCH_BUTTON_NUM] = {
     0.03, // 3%.
 };
 
-static QueueHandle_t que_touch = NULL;
-typedef struct touch_msg {
-    touch_pad_intr_mask_t intr_mask;
-    uint32_t pad_num;
-    uint32_t pad_status;
-    uint32_t pad_val;
-    uint32_t slp_proxi_cnt;
-    uint32_t slp_proxi_base;
-} touch_event_t;
-
-static void touchsensor_set_thresholds(void)
+// Settling time of the benchmark before the thresholds are derived from it
+#define TOUCH_SETTLE_MS     50
+
+static esp_timer_handle_t touch_settle_timer = NULL;
+
+/*
+ * Interrupt status handed to the reactor in one word:
+ * bit 0-7 interrupt mask, bit 8-15 pad number, bit 16-31 pad status.
+ */
+#define TOUCH_EVT_MASK(evt)     ((touch_pad_intr_mask_t)((evt) & 0xFF))
+#define TOUCH_EVT_PAD(evt)      (((evt) >> 8) & 0xFF)
+#define TOUCH_EVT_STATUS(evt)   ((evt) >> 16)
+
+static void touchsensor_set_thresholds(void *arg, uint32_t value)
 {
     uint32_t touch_value;
     for (int i = 0; i < TOUCH_BUTTON_NUM; i++) {
@@ -66,73 +74,71 @@ static void touchsensor_filter_set(touch_filter_mode_t mode)
     ESP_LOGI(TAG, "touch pad filter init");
 }
 
+static uint8_t button_state = 0;
+static void touchsensor_post(button_event_t id)
+{
+    event_t event = {.base = BUTTON_EVENT, .id = id, .data.buttons = button_state};
+    events_post_event(&event);
+}
+
+static void touchsensor_handle_event(void *arg, uint32_t evt)
+{
+    touch_pad_intr_mask_t intr_mask = TOUCH_EVT_MASK(evt);
+    uint32_t pad_num = TOUCH_EVT_PAD(evt);
+    uint32_t pad_status = TOUCH_EVT_STATUS(evt);
+
+    if (intr_mask & TOUCH_PAD_INTR_MASK_ACTIVE) {
+        ESP_LOGD(TAG, "TouchSensor [%"PRIu32"] be activated, status mask 0x%"PRIu32"", pad_num, pad_status);
+        if (pad_num == button[0]) {
+            button_state |= 1;
+            touchsensor_post(BUTTON_EVENT_LBUTTONDOWN);
+        } else if (pad_num == button[1]) {
+            button_state |= (1 << 1);
+            touchsensor_post(BUTTON_EVENT_RBUTTONDOWN);
+        }
+    }
+
+    if (intr_mask & TOUCH_PAD_INTR_MASK_INACTIVE) {
+        ESP_LOGD(TAG, "TouchSensor [%"PRIu32"] be inactivated, status mask 0x%"PRIu32, pad_num, pad_status);
+        if (pad_num == button[0]) {
+            button_state &= ~(1);
+            touchsensor_post(BUTTON_EVENT_LBUTTONUP);
+        } else if (pad_num == button[1]) {
+            button_state &= ~(1 << 1);
+            touchsensor_post(BUTTON_EVENT_RBUTTONUP);
+        }
+    }
+
+    if (intr_mask & TOUCH_PAD_INTR_MASK_TIMEOUT) {
+        /* Add your exception handling in here. */
+        ESP_LOGW(TAG, "Touch sensor channel %"PRIu32" measure timeout. Skip this exception channel!!", pad_num);
+        touch_pad_timeout_resume(); // Point on the next channel to measure.
+    }
+}
+
 /*
   Handle an interrupt triggered when a pad is touched.
-  Recognize what pad has been touched and save it in a table.
+  Recognize what pad has been touched and hand it to the reactor.
  */
 static void touchsensor_interrupt_cb(void *arg)
 {
-    int task_awoken = pdFALSE;
-    touch_event_t evt;
-
-    evt.intr_mask = (touch_pad_intr_mask_t) touch_pad_read_intr_status_mask();
-    evt.pad_status = touch_pad_get_status();
-    evt.pad_num = touch_pad_get_current_meas_channel();
+    BaseType_t task_awoken = pdFALSE;
+    uint32_t evt = (touch_pad_read_intr_status_mask() & 0xFF)
+            | (touch_pad_get_current_meas_channel() & 0xFF) << 8
+            | touch_pad_get_status() << 16;
 
-    xQueueSendFromISR(que_touch, &evt, &task_awoken);
+    reactor_call_from_isr(touchsensor_handle_event, NULL, evt, &task_awoken);
     if (task_awoken == pdTRUE) {
         portYIELD_FROM_ISR();
     }
 }
 
-static uint8_t button_state = 0;
-static void touchsensor_read_task(void *pvParameter)
+static void touchsensor_settle_timer_cb(void *arg)
 {
-    touch_event_t evt = {};
-
-    /* Wait touch sensor init done */
-    vTaskDelay(50 / portTICK_PERIOD_MS);
-    touchsensor_set_thresholds();
-
-    while (1) {
-        int ret = xQueueReceive(que_touch, &evt, (TickType_t)portMAX_DELAY);
-        if (ret != pdTRUE) continue;
-
-        if (evt.intr_mask & TOUCH_PAD_INTR_MASK_ACTIVE) {
-            ESP_LOGD(TAG, "TouchSensor [%"PRIu32"] be activated, status mask 0x%"PRIu32"", evt.pad_num, evt.pad_status);
-            if (evt.pad_num == button[0]) {
-                button_state |= 1;
-                esp_event_post(BUTTON_EVENT, BUTTON_EVENT_LBUTTONDOWN, &button_state, sizeof(button_state), portMAX_DELAY);
-            } else if (evt.pad_num == button[1]) {
-                button_state |= (1 << 1);
-                esp_event_post(BUTTON_EVENT, BUTTON_EVENT_RBUTTONDOWN, &button_state, sizeof(button_state), portMAX_DELAY);
-            }
-        }
-
-        if (evt.intr_mask & TOUCH_PAD_INTR_MASK_INACTIVE) {
-            ESP_LOGD(TAG, "TouchSensor [%"PRIu32"] be inactivated, status mask 0x%"PRIu32, evt.pad_num, evt.pad_status);
-            if (evt.pad_num == button[0]) {
-                button_state &= ~(1);
-                esp_event_post(BUTTON_EVENT, BUTTON_EVENT_LBUTTONUP, &button_state, sizeof(button_state), portMAX_DELAY);
-            } else if (evt.pad_num == button[1]) {
-                button_state &= ~(1 << 1);
-                esp_event_post(BUTTON_EVENT, BUTTON_EVENT_RBUTTONUP, &button_state, sizeof(button_state), portMAX_DELAY);
-            }
-        }
-
-        if (evt.intr_mask & TOUCH_PAD_INTR_MASK_TIMEOUT) {
-            /* Add your exception handling in here. */
-            ESP_LOGW(TAG, "Touch sensor channel %"PRIu32" measure timeout. Skip this exception channel!!", evt.pad_num);
-            touch_pad_timeout_resume(); // Point on the next channel to measure.
-        }
-    }
+    reactor_call(touchsensor_set_thresholds, NULL, 0);
 }
 
 void touchsensor_init() {
-    if (que_touch == NULL) {
-        que_touch = xQueueCreate(TOUCH_BUTTON_NUM, sizeof(touch_event_t));
-    }
-
     // Initialize touch pad peripheral, it will start a timer to run a filter
     ESP_LOGI(TAG, "Initializing touch pad");
     /* Initialize touch pad peripheral. */
@@ -180,7 +186,18 @@ void touchsensor_init() {
     /* Enable touch sensor clock. Work mode is "timer trigger". */
     touch_pad_set_fsm_mode(TOUCH_FSM_MODE_TIMER);
     touch_pad_fsm_start();
-    
-    // Start a task to show what pads have been touched
-    xTaskCreate(&touchsensor_read_task, "task_touch", 4096, NULL, 10, NULL);
+
+#if CONFIG_AUDIO_PM_SLEEP_IN_SUSPEND
+    /* The FSM keeps measuring in light sleep, a touch wakes the chip up. */
+    esp_sleep_enable_touchpad_wakeup();
+#endif
+
+    /* Wait touch sensor init done, the reactor then sets the thresholds */
+    const esp_timer_create_args_t settle_timer_args = {
+        .callback = touchsensor_settle_timer_cb,
+        .name = "touch_settle",
+    };
+    if (esp_timer_create(&settle_timer_args, &touch_settle_timer) == ESP_OK) {
+        esp_timer_start_once(touch_settle_timer, TOUCH_SETTLE_MS * 1000);
+    }
 }
\ No newline at end of file
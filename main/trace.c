@@ -0,0 +1,84 @@
+#include "trace.h"
+
+#if CONFIG_AUDIO_TRACE
+
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include <string.h>
+
+#define TRACE_RECORDS   CONFIG_AUDIO_TRACE_RECORDS
+_Static_assert((TRACE_RECORDS & (TRACE_RECORDS - 1)) == 0, "trace buffer size must be a power of two");
+_Static_assert(TRACE_RECORDS <= 65536, "trace buffer larger than the record sequence number");
+_Static_assert(sizeof(trace_record_t) == 16, "trace record layout changed");
+
+static trace_record_t mRing[TRACE_RECORDS];
+
+// Index of the next record to write, only ever incremented
+static uint32_t mHead = 0;
+// Index of the first record not dumped yet
+static uint32_t mStart = 0;
+
+void IRAM_ATTR trace_record(trace_event_t event, uint32_t arg0, uint32_t arg1)
+{
+    uint32_t index = __atomic_fetch_add(&mHead, 1, __ATOMIC_RELAXED);
+    trace_record_t *record = &mRing[index & (TRACE_RECORDS - 1)];
+
+    // Invalidate first so a concurrent reader never accepts a half written record
+    __atomic_store_n(&record->seq, (uint16_t)~index, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    record->timestamp = esp_timer_get_time();
+    record->event = event;
+    record->core = esp_cpu_get_core_id();
+    record->arg0 = arg0;
+    record->arg1 = arg1;
+    __atomic_store_n(&record->seq, (uint16_t)index, __ATOMIC_RELEASE);
+}
+
+void trace_snapshot(trace_cursor_t *cursor, trace_dump_header_t *header)
+{
+    uint32_t end = __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+    uint32_t start = mStart;
+    uint32_t lost = 0;
+    if(end - start > TRACE_RECORDS) {
+        lost = end - start - TRACE_RECORDS;
+        start = end - TRACE_RECORDS;
+    }
+    mStart = end;
+
+    cursor->next = start;
+    cursor->end = end;
+
+    memcpy(header->magic, TRACE_DUMP_MAGIC, sizeof(header->magic));
+    header->version = TRACE_DUMP_VERSION;
+    header->record_size = sizeof(trace_record_t);
+    header->cpu_mhz = esp_rom_get_cpu_ticks_per_us();
+    header->count = end - start;
+    header->lost = lost;
+}
+
+bool trace_read(trace_cursor_t *cursor, trace_record_t *record)
+{
+    if(cursor->next == cursor->end) return false;
+
+    uint32_t index = cursor->next++;
+    const trace_record_t *slot = &mRing[index & (TRACE_RECORDS - 1)];
+    uint16_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    *record = *slot;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(seq != (uint16_t)index || __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+        // Overwritten by a writer that lapped the reader, or still being written
+        memset(record, 0, sizeof(*record));
+        record->event = TRACE_NONE;
+        record->seq = index;
+    }
+    return true;
+}
+
+void trace_clear()
+{
+    mStart = __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+}
+
+#endif
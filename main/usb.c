@@ -2,17 +2,39 @@
 #include "esp_log.h"
 #include "esp_private/usb_phy.h"
 #include "soc/usb_pins.h"
+#include "soc/usb_reg.h"
 #include "esp_check.h"
 #include "audio.h"
+#include "settings.h"
+#include "profile.h"
+#include "latency.h"
+#include "trace.h"
+#include "stats.h"
+#include "siggen.h"
 #include "global.h"
+#include "events.h"
+#include "tasks.h"
 
 static const char *TAG = "USB";
 
+static void usb_restore_controls(void);
+
+static StaticTask_t mTusbTaskBuf;
+static StackType_t mTusbStack[CONFIG_TINYUSB_TASK_STACK_SIZE];
+
 /**
  * @brief This top level thread processes all usb events and invokes callbacks
  */
 static void tusb_device_task(void *arg)
 {
+  // The USB interrupt is allocated on the core calling tusb_init(), the audio core of this task
+  bool ok = tusb_init();
+  xTaskNotify((TaskHandle_t)arg, ok, eSetValueWithOverwrite);
+  if (!ok) {
+    vTaskDelete(NULL);
+    return;
+  }
+
   ESP_LOGI(TAG, "USB task started");
   while (1) tud_task();
 }
@@ -27,17 +49,21 @@ static void tusb_device_task(void *arg)
 bool usb_report_buttons(uint16_t report)
 {
   if(!tud_hid_ready()) {
+    TRACE(HID_REPORT, report, false);
     ESP_LOGW(TAG, "HID not ready");
     return false;
   }
   
-  return tud_hid_report(1, &report, sizeof(report));
+  bool sent = tud_hid_report(HID_REPORT_ID_BUTTONS, &report, sizeof(report));
+  TRACE(HID_REPORT, report, sent);
+  return sent;
 }
 
 esp_err_t usb_init()
 {
   // 下面是个空函数，但是不加会报 undefined reference，不太明白具体什么原因
   usb_descriptors_dummy();
+  usb_restore_controls();
 
   // Configure USB PHY
   usb_phy_config_t phy_conf = {
@@ -48,9 +74,13 @@ esp_err_t usb_init()
 
   usb_phy_handle_t phy_hdl;
   ESP_RETURN_ON_ERROR(usb_new_phy(&phy_conf, &phy_hdl), TAG, "Install USB PHY failed");
-  ESP_RETURN_ON_FALSE(tusb_init(), ESP_FAIL, TAG, "Init TinyUSB stack failed");
 
-  xTaskCreatePinnedToCore(tusb_device_task, "TinyUSB", CONFIG_TINYUSB_TASK_STACK_SIZE, NULL, CONFIG_TINYUSB_TASK_PRIORITY, NULL, 1);
+  xTaskCreateStaticPinnedToCore(tusb_device_task, "TinyUSB", CONFIG_TINYUSB_TASK_STACK_SIZE,
+      xTaskGetCurrentTaskHandle(), CONFIG_TINYUSB_TASK_PRIORITY, mTusbStack, &mTusbTaskBuf, TASK_CORE_AUDIO);
+
+  uint32_t initialized = 0;
+  xTaskNotifyWait(0, UINT32_MAX, &initialized, portMAX_DELAY);
+  ESP_RETURN_ON_FALSE(initialized, ESP_FAIL, TAG, "Init TinyUSB stack failed");
 
   ESP_LOGI(TAG, "USB initialized");
   return ESP_OK;
@@ -69,11 +99,21 @@ uint32_t current_sample_rate = 44100;
 #define N_SAMPLE_RATES TU_ARRAY_SIZE(sample_rates)
 
 // Audio controls
-// Current states
+// Current states, restored from settings in usb_init()
 int8_t mute = 0;
 
-// TODO save volume in NVS?
-int16_t volume = (AUDIO_VOLUME_DEFAULT + USB_VOLUME_OFFSET) * 256;
+// Master, then left and right channel
+int16_t volume[3] = {(AUDIO_VOLUME_DEFAULT + USB_VOLUME_OFFSET) * 256, 0, 0};
+
+// Report the controls restored by settings_init() to the host
+static void usb_restore_controls(void)
+{
+  const settings_t *settings = settings_get();
+  for (int i = 0; i < TU_ARRAY_SIZE(volume); i++) {
+    volume[i] = settings->volume[i] + USB_VOLUME_OFFSET * 256;
+  }
+  mute = settings->mute;
+}
 
 //--------------------------------------------------------------------+
 // Device callbacks
@@ -82,13 +122,13 @@ int16_t volume = (AUDIO_VOLUME_DEFAULT + USB_VOLUME_OFFSET) * 256;
 // Invoked when device is mounted
 void tud_mount_cb(void)
 {
-  esp_event_post(USB_EVENT, USB_EVENT_MOUNT, NULL, 0, portMAX_DELAY);
+  events_post(USB_EVENT, USB_EVENT_MOUNT);
 }
 
 // Invoked when device is unmounted
 void tud_umount_cb(void)
 {
-  esp_event_post(USB_EVENT, USB_EVENT_UNMOUNT, NULL, 0, portMAX_DELAY);
+  events_post(USB_EVENT, USB_EVENT_UNMOUNT);
 }
 
 // Invoked when usb bus is suspended
@@ -96,13 +136,13 @@ void tud_umount_cb(void)
 // Within 7ms, device must draw an average of current less than 2.5 mA from bus
 void tud_suspend_cb(bool remote_wakeup_en)
 {
-  esp_event_post(USB_EVENT, USB_EVENT_SUSPEND, NULL, 0, portMAX_DELAY);
+  events_post(USB_EVENT, USB_EVENT_SUSPEND);
 }
 
 // Invoked when usb bus is resumed
 void tud_resume_cb(void)
 {
-  esp_event_post(USB_EVENT, USB_EVENT_RESUME, NULL, 0, portMAX_DELAY);
+  events_post(USB_EVENT, USB_EVENT_RESUME);
 }
 
 // Helper for clock get requests
@@ -176,17 +216,21 @@ static bool tud_audio_feature_unit_get_request(uint8_t rhport, audio_control_req
   }
   else if (UAC2_ENTITY_SPK_FEATURE_UNIT && request->bControlSelector == AUDIO_FU_CTRL_VOLUME)
   {
+    TU_VERIFY(request->bChannelNumber < TU_ARRAY_SIZE(volume));
+
     if (request->bRequest == AUDIO_CS_REQ_RANGE)
     {
+      // Channel volumes only attenuate, they are added to the master volume
+      int16_t max = request->bChannelNumber == 0 ? USB_VOLUME_MAX : USB_CHANNEL_VOLUME_MAX;
       audio_control_range_2_n_t(1) range_vol = {
           .wNumSubRanges = tu_htole16(1),
-          .subrange[0] = {.bMin = tu_htole16((AUDIO_VOLUME_MIN + USB_VOLUME_OFFSET) * 256), tu_htole16((USB_VOLUME_MAX + USB_VOLUME_OFFSET) * 256), tu_htole16(AUDIO_VOLUME_RES * 256)},
+          .subrange[0] = {.bMin = tu_htole16((AUDIO_VOLUME_MIN + USB_VOLUME_OFFSET) * 256), tu_htole16((max + USB_VOLUME_OFFSET) * 256), tu_htole16(AUDIO_VOLUME_RES * 256)},
         };
       return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *)request, &range_vol, sizeof(range_vol));
     }
     else if (request->bRequest == AUDIO_CS_REQ_CUR)
     {
-      audio_control_cur_2_t cur_vol = {.bCur = tu_htole16(volume)};
+      audio_control_cur_2_t cur_vol = {.bCur = tu_htole16(volume[request->bChannelNumber])};
       return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *)request, &cur_vol, sizeof(cur_vol));
     }
   }
@@ -196,6 +240,23 @@ static bool tud_audio_feature_unit_get_request(uint8_t rhport, audio_control_req
   return false;
 }
 
+// Helper for output terminal get requests
+static bool tud_audio_output_terminal_get_request(uint8_t rhport, audio_control_request_t const *request)
+{
+  TU_ASSERT(request->bEntityID == UAC2_ENTITY_SPK_OUTPUT_TERMINAL);
+
+  if (request->bControlSelector == AUDIO_TE_CTRL_LATENCY && request->bRequest == AUDIO_CS_REQ_CUR)
+  {
+    // Latency is reported in ns
+    audio_control_cur_4_t cur_latency = {.bCur = tu_htole32(latency_get_us() * 1000)};
+    return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *)request, &cur_latency, sizeof(cur_latency));
+  }
+  ESP_LOGW(TAG, "Output terminal get request not supported, entity = %u, selector = %u, request = %u",
+          request->bEntityID, request->bControlSelector, request->bRequest);
+
+  return false;
+}
+
 // Helper for feature unit set requests
 static bool tud_audio_feature_unit_set_request(uint8_t rhport, audio_control_request_t const *request, uint8_t const *buf)
 {
@@ -209,6 +270,7 @@ static bool tud_audio_feature_unit_set_request(uint8_t rhport, audio_control_req
     int8_t mute_target = ((audio_control_cur_1_t const *)buf)->bCur;
     if(audio_set_mute(request->bChannelNumber, mute_target) == ESP_OK) {
       mute = mute_target;
+      if (request->bChannelNumber == 0) settings_set_mute(mute);
     } else {
       ESP_LOGE(TAG, "Failed to set mute");
     }
@@ -218,10 +280,12 @@ static bool tud_audio_feature_unit_set_request(uint8_t rhport, audio_control_req
   else if (request->bControlSelector == AUDIO_FU_CTRL_VOLUME)
   {
     TU_VERIFY(request->wLength == sizeof(audio_control_cur_2_t));
+    TU_VERIFY(request->bChannelNumber < TU_ARRAY_SIZE(volume));
 
     int16_t volume_target = ((audio_control_cur_2_t const *)buf)->bCur;
-    if(audio_set_volume(((float)volume_target + USB_VOLUME_OFFSET) / 256.f) == ESP_OK) {
-      volume = volume_target;
+    if(audio_set_volume(request->bChannelNumber, ((float)volume_target + USB_VOLUME_OFFSET) / 256.f) == ESP_OK) {
+      volume[request->bChannelNumber] = volume_target;
+      settings_set_volume(request->bChannelNumber, volume_target - USB_VOLUME_OFFSET * 256);
     } else {
       ESP_LOGE(TAG, "Failed to set volume");
     }
@@ -249,6 +313,8 @@ bool tud_audio_get_req_entity_cb(uint8_t rhport, tusb_control_request_t const *p
     return tud_audio_clock_get_request(rhport, request);
   if (request->bEntityID == UAC2_ENTITY_SPK_FEATURE_UNIT)
     return tud_audio_feature_unit_get_request(rhport, request);
+  if (request->bEntityID == UAC2_ENTITY_SPK_OUTPUT_TERMINAL)
+    return tud_audio_output_terminal_get_request(rhport, request);
   else
   {
     ESP_LOGW(TAG, "Get request not handled, entity = %d, selector = %d, request = %d",
@@ -282,9 +348,11 @@ bool tud_audio_set_itf_close_EP_cb(uint8_t rhport, tusb_control_request_t const
   ESP_LOGD(TAG, "Set interface close EP %d alt %d", itf, alt);
 
   if (ITF_NUM_AUDIO_STREAMING_SPK == itf) {
-    // state: streaming -> idle
-    audio_stop();
-    esp_event_post(USB_EVENT, USB_EVENT_STREAM_STOP, NULL, 0, portMAX_DELAY);
+    // state: streaming -> idle, unless the test signal generator owns the stream
+    if (!siggen_running()) {
+      audio_stop();
+    }
+    events_post(USB_EVENT, USB_EVENT_STREAM_STOP);
   }
   
   return true;
@@ -306,8 +374,11 @@ bool tud_audio_set_itf_cb(uint8_t rhport, tusb_control_request_t const *p_reques
       cfg.bits_per_sample = CFG_TUD_AUDIO_FUNC_1_FORMAT_2_RESOLUTION_RX;
     }
 
+    // The host stream takes over from the test signal generator
+    siggen_stop();
     audio_start(&cfg);
-    esp_event_post(USB_EVENT, USB_EVENT_STREAM_START, NULL, 0, portMAX_DELAY);
+    event_t event = {.base = USB_EVENT, .id = USB_EVENT_STREAM_START, .data.stream = cfg};
+    events_post_event(&event);
   }
 
   return true;
@@ -315,23 +386,84 @@ bool tud_audio_set_itf_cb(uint8_t rhport, tusb_control_request_t const *p_reques
 
 bool tud_audio_rx_done_pre_read_cb(uint8_t rhport, uint16_t n_bytes_received, uint8_t func_id, uint8_t ep_out, uint8_t cur_alt_setting)
 {
-  uint8_t spk_buf[CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ];
+  // Static, the TinyUSB task stack then does not have to hold a full packet
+  static TU_ATTR_ALIGNED(4) uint8_t spk_buf[CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ];
+  TRACE(USB_RX, n_bytes_received, cur_alt_setting);
+  stats_count_packet();
+  PROFILE_BEGIN(read_start);
   int spk_data_size = tud_audio_read(spk_buf, n_bytes_received);
+  PROFILE_END(PROFILE_STAGE_USB_READ, read_start);
+  if (siggen_running()) {
+    // Started from the console over a host stream, the generator has the I2S channel
+    return true;
+  }
+
+  // Software gain, and 32bit to 24bit repack for alt 2
+  uint8_t slot_bytes = cur_alt_setting == 2 ? CFG_TUD_AUDIO_FUNC_1_FORMAT_2_N_BYTES_PER_SAMPLE_RX : CFG_TUD_AUDIO_FUNC_1_FORMAT_1_N_BYTES_PER_SAMPLE_RX;
+  return audio_play(spk_buf, spk_data_size, slot_bytes, AUDIO_WAIT_NONE) == ESP_OK;
+}
 
-  // TODO use optimized algorithm
-  if(cur_alt_setting == 2 && CFG_TUD_AUDIO_FUNC_1_FORMAT_2_RESOLUTION_RX == 24 && CFG_TUD_AUDIO_FUNC_1_FORMAT_2_N_BYTES_PER_SAMPLE_RX == 4) {
-    // 32bit to 24bit
-    uint8_t *dst = spk_buf;
-    for(int i=0; i<spk_data_size; i+= 4) {
-      memcpy(dst, spk_buf + i + 1, 3);
-      dst += 3;
+#if CFG_TUD_DCD_ISR_PROBE
+// Invoked by the DCD at the end of every USB interrupt, only packet arrivals are profiled
+void IRAM_ATTR tud_dcd_isr_probe_cb(uint32_t cycles, uint32_t int_status)
+{
+  TRACE(USB_ISR, int_status, cycles);
+#if CONFIG_AUDIO_PROFILE
+  if (int_status & USB_RXFLVI_M) {
+    profile_record(PROFILE_STAGE_DCD_ISR, cycles);
+  }
+#endif
+}
+#endif
+
+//--------------------------------------------------------------------+
+// Vendor Callback API Implementations
+//--------------------------------------------------------------------+
+
+#if CFG_TUD_VENDOR
+static trace_cursor_t trace_cursor;
+static bool trace_dumping = false;
+
+// Queue as many records of the current dump as the TX FIFO takes
+static void trace_dump_pump(void)
+{
+  trace_record_t record;
+  while (trace_dumping && tud_vendor_write_available() >= sizeof(record))
+  {
+    if (!trace_read(&trace_cursor, &record)) {
+      trace_dumping = false;
+      break;
     }
-    spk_data_size = spk_data_size / 4 * 3;
+    tud_vendor_write(&record, sizeof(record));
   }
+  tud_vendor_flush();
+}
 
-  return audio_write(spk_data_size, spk_buf) == ESP_OK;
+// Invoked when the host sent a command on the trace interface
+void tud_vendor_rx_cb(uint8_t itf)
+{
+  uint8_t cmd;
+  while (tud_vendor_read(&cmd, 1) == 1)
+  {
+    if (cmd == TRACE_CMD_DUMP && !trace_dumping) {
+      trace_dump_header_t header;
+      trace_snapshot(&trace_cursor, &header);
+      tud_vendor_write(&header, sizeof(header));
+      trace_dumping = true;
+      trace_dump_pump();
+    } else if (cmd == TRACE_CMD_CLEAR) {
+      trace_clear();
+    }
+  }
 }
 
+// Invoked when a transfer on the trace interface completed
+void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes)
+{
+  trace_dump_pump();
+}
+#endif
+
 //--------------------------------------------------------------------+
 // HID Callback API Implementations
 //--------------------------------------------------------------------+
@@ -363,8 +495,40 @@ void tud_hid_report_complete_cb(uint8_t instance, uint8_t const* report, /*uint1
 // Invoked when received GET_REPORT control request
 // Application must fill buffer report's content and return its length.
 // Return zero will cause the stack to STALL request
+#if CONFIG_AUDIO_STATS
+// First task of the next task list page, selected by the host
+static uint8_t stats_first_task = 0;
+
+TU_VERIFY_STATIC(sizeof(stats_report_t) <= HID_STATS_REPORT_LEN, "stats report too large");
+TU_VERIFY_STATIC(sizeof(stats_tasks_report_t) <= HID_STATS_REPORT_LEN, "tasks report too large");
+TU_VERIFY_STATIC(sizeof(stats_verify_report_t) <= HID_STATS_REPORT_LEN, "verify report too large");
+#endif
+
 uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t* buffer, uint16_t reqlen)
 {
+#if CONFIG_AUDIO_STATS
+  if (report_type == HID_REPORT_TYPE_FEATURE && (report_id == HID_REPORT_ID_STATS || report_id == HID_REPORT_ID_TASKS || report_id == HID_REPORT_ID_VERIFY))
+  {
+    // Reports are always sent at the declared size, zero padded
+    uint16_t len = tu_min16(reqlen, HID_STATS_REPORT_LEN);
+    memset(buffer, 0, len);
+
+    if (report_id == HID_REPORT_ID_STATS) {
+      stats_report_t report;
+      stats_get_report(&report);
+      memcpy(buffer, &report, tu_min16(len, sizeof(report)));
+    } else if (report_id == HID_REPORT_ID_TASKS) {
+      stats_tasks_report_t report;
+      stats_get_tasks_report(stats_first_task, &report);
+      memcpy(buffer, &report, tu_min16(len, sizeof(report)));
+    } else {
+      stats_verify_report_t report;
+      stats_get_verify_report(&report);
+      memcpy(buffer, &report, tu_min16(len, sizeof(report)));
+    }
+    return len;
+  }
+#endif
   return 0;
 }
 
@@ -372,5 +536,10 @@ uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_t
 // received data on OUT endpoint ( Report ID = 0, Type = 0 )
 void tud_hid_set_report_cb(uint8_t itf, uint8_t report_id, hid_report_type_t report_type, uint8_t const* buffer, uint16_t bufsize)
 {
-  
+#if CONFIG_AUDIO_STATS
+  if (report_type == HID_REPORT_TYPE_FEATURE && report_id == HID_REPORT_ID_TASKS && bufsize >= 1)
+  {
+    stats_first_task = buffer[0];
+  }
+#endif
 }
@@ -5,7 +5,9 @@
  * Same VID/PID with different interface e.g MSC (first), then CDC (later) will possibly cause system error on PC.
  *
  * Auto ProductID layout's Bitmap:
- *   [MSB]     AUDIO | MIDI | HID | MSC | CDC          [LSB]
+ *   [MSB]     VENDOR | AUDIO | MIDI | HID | MSC | CDC          [LSB]
+ *
+ * CDC is set with the diagnostics console (CONFIG_AUDIO_CONSOLE), VENDOR with the trace dump (CONFIG_AUDIO_TRACE).
  */
 #define _PID_MAP(itf, n)  ( (CFG_TUD_##itf) << (n) )
 #define USB_PID           (0x4000 | _PID_MAP(CDC, 0) | _PID_MAP(MSC, 1) | _PID_MAP(HID, 2) | \
@@ -45,7 +47,10 @@ uint8_t const * tud_descriptor_device_cb(void)
 
 uint8_t const desc_hid_report[] =
 {
-  TUD_HID_REPORT_DESC_HEADSET()
+  TUD_HID_REPORT_DESC_HEADSET(),
+#if CONFIG_AUDIO_STATS
+  TUD_HID_REPORT_DESC_STATS(),
+#endif
 };
 
 // Invoked when received GET HID REPORT DESCRIPTOR
@@ -61,9 +66,15 @@ uint8_t const * tud_hid_descriptor_report_cb(uint8_t instance)
 //--------------------------------------------------------------------+
 
 // #define TUSB_DESC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + CFG_TUD_HID * TUD_HID_DESC_LEN)
-#define TUSB_DESC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + CFG_TUD_AUDIO * TUD_AUDIO_HEADSET_STEREO_DESC_LEN + CFG_TUD_HID * TUD_HID_DESC_LEN)
+#define TUSB_DESC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + CFG_TUD_AUDIO * TUD_AUDIO_HEADSET_STEREO_DESC_LEN + CFG_TUD_HID * TUD_HID_DESC_LEN + CFG_TUD_CDC * TUD_CDC_DESC_LEN + CFG_TUD_VENDOR * TUD_VENDOR_DESC_LEN)
 #define EPNUM_AUDIO_OUT          0x01
 #define EPNUM_VOLUME_CONTROL_IN  0x81
+#define EPNUM_TRACE_OUT          0x02
+#define EPNUM_TRACE_IN           0x82
+// With both console and trace all 5 IN endpoints of the ESP32-S3 are used, EP0 included
+#define EPNUM_CONSOLE_NOTIF      0x83
+#define EPNUM_CONSOLE_OUT        0x04
+#define EPNUM_CONSOLE_IN         0x84
 
 static const uint8_t desc_configuration[] =
 {
@@ -75,6 +86,16 @@ static const uint8_t desc_configuration[] =
 
     // Interface number, string index, protocol, report descriptor len, EP In address, size & polling interval
     TUD_HID_DESCRIPTOR(ITF_NUM_VOLUME_CONTROL, 0, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_report), EPNUM_VOLUME_CONTROL_IN, CFG_TUD_HID_EP_BUFSIZE, 1),
+
+#if CFG_TUD_CDC
+    // Interface number, string index, EP notification address and size, EP data address (out, in) and size
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CONSOLE, 6, EPNUM_CONSOLE_NOTIF, 8, EPNUM_CONSOLE_OUT, EPNUM_CONSOLE_IN, CFG_TUD_CDC_EP_BUFSIZE),
+#endif
+
+#if CFG_TUD_VENDOR
+    // Interface number, string index, EP Out & IN address, EP size
+    TUD_VENDOR_DESCRIPTOR(ITF_NUM_TRACE, 5, EPNUM_TRACE_OUT, EPNUM_TRACE_IN, CFG_TUD_VENDOR_EPSIZE),
+#endif
 };
 
 // Invoked when received GET CONFIGURATION DESCRIPTOR
@@ -98,6 +119,8 @@ static const char* string_desc_arr[] = {
     "S3 Audio",            // 2: Product
     "000001",              // 3: Serials, should use chip ID
     "S3 Audio Speakers",   // 4: Audio Interface
+    "S3 Audio Trace",      // 5: Trace Interface
+    "S3 Audio Console",    // 6: CDC Interface
 };
 
 
@@ -0,0 +1,128 @@
+#include "verify.h"
+
+#if CONFIG_AUDIO_VERIFY
+
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_rom_crc.h"
+#include <stdbool.h>
+#include <string.h>
+
+static const char *TAG = "verify";
+
+static uint32_t mBits = 0;
+static uint32_t mMask = 0;
+static uint32_t mExpected = 0;
+static bool mLocked = false;            // a pattern frame has been seen this session
+static verify_summary_t mSummary = {0};
+
+// Head of a frame split across writes, checked once the rest arrives
+static uint8_t mCarry[8];
+static uint32_t mCarryBytes = 0;
+
+void verify_start(uint32_t bits_per_sample)
+{
+    mBits = bits_per_sample;
+    mMask = bits_per_sample == 32 ? UINT32_MAX : (1UL << bits_per_sample) - 1;
+    mLocked = false;
+    mCarryBytes = 0;
+    memset(&mSummary, 0, sizeof(mSummary));
+}
+
+/**
+ * @brief Account a pattern frame against the counter sequence
+*/
+static inline void verify_frame(uint32_t left, uint32_t right)
+{
+    if(!mLocked) {
+        mLocked = true;
+        mSummary.first = mExpected = left;
+    }
+    mSummary.frames++;
+
+    if(right != verify_pattern_check(left, mBits)) {
+        // The counter itself may be the corrupted sample, keep counting from the expected one
+        mSummary.corrupted++;
+        mExpected = (mExpected + 1) & mMask;
+        return;
+    }
+
+    // Distances up to half the counter range are drops, anything further went backwards
+    uint32_t skipped = (left - mExpected) & mMask;
+    if(skipped > mMask / 2) {
+        mSummary.duplicated += mMask + 1 - skipped;
+    } else {
+        mSummary.dropped += skipped;
+    }
+    mExpected = (left + 1) & mMask;
+}
+
+static inline uint32_t verify_load(const uint8_t *sample, uint32_t bytes)
+{
+    if(bytes == 2) return sample[0] | sample[1] << 8;
+    if(bytes == 3) return sample[0] | sample[1] << 8 | sample[2] << 16;
+    return sample[0] | sample[1] << 8 | sample[2] << 16 | (uint32_t)sample[3] << 24;
+}
+
+/**
+ * @brief Check and checksum whole frames
+ *
+ * Kept out of line for its own IRAM entry in main/linker.lf.
+*/
+static NOINLINE_ATTR void verify_frames(const uint8_t *p, size_t size)
+{
+    const uint32_t sample_bytes = mBits / 8;
+    const uint32_t frame_bytes = 2 * sample_bytes;
+    const uint8_t *run = NULL;          // first byte of the pattern frames not yet in the CRC
+
+    for(size_t offset = 0; offset < size; offset += frame_bytes) {
+        uint32_t left = verify_load(p + offset, sample_bytes);
+        uint32_t right = verify_load(p + offset + sample_bytes, sample_bytes);
+
+        // Silence around the pattern is not part of the stream under test
+        if(left == 0 && right == 0) {
+            if(run) mSummary.crc = esp_rom_crc32_le(mSummary.crc, run, p + offset - run);
+            run = NULL;
+            continue;
+        }
+        if(!run) run = p + offset;
+        verify_frame(left, right);
+    }
+    if(run) mSummary.crc = esp_rom_crc32_le(mSummary.crc, run, p + size - run);
+}
+
+void verify_update(const void *data, size_t size)
+{
+    const uint32_t frame_bytes = 2 * (mBits / 8);
+    const uint8_t *p = data;
+
+    if(mCarryBytes) {
+        size_t rest = frame_bytes - mCarryBytes < size ? frame_bytes - mCarryBytes : size;
+        memcpy(mCarry + mCarryBytes, p, rest);
+        mCarryBytes += rest;
+        p += rest;
+        size -= rest;
+        if(mCarryBytes < frame_bytes) return;
+        verify_frames(mCarry, frame_bytes);
+        mCarryBytes = 0;
+    }
+
+    size_t whole = size - size % frame_bytes;
+    verify_frames(p, whole);
+    memcpy(mCarry, p + whole, size - whole);
+    mCarryBytes = size - whole;
+}
+
+void verify_stop()
+{
+    if(!mLocked) return;
+    ESP_LOGI(TAG, "%lu frames from %lu, crc %08lx, %lu dropped, %lu duplicated, %lu corrupted",
+            mSummary.frames, mSummary.first, mSummary.crc, mSummary.dropped, mSummary.duplicated, mSummary.corrupted);
+}
+
+void verify_get_summary(verify_summary_t *summary)
+{
+    *summary = mSummary;
+}
+
+#endif
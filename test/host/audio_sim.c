@@ -0,0 +1,571 @@
+#include "sim.h"
+#include "audio.h"
+#include "usb.h"
+#include "latency.h"
+#include "settings.h"
+#include "global.h"
+#include "siggen.h"
+#include "profile.h"
+#include "verify.h"
+#include "esp_rom_crc.h"
+#include "esp_log.h"
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+ESP_EVENT_DEFINE_BASE(BUTTON_EVENT);
+ESP_EVENT_DEFINE_BASE(USB_EVENT);
+
+// Implemented in latency.c, the DCD calls it on every SOF on the device
+void tud_dcd_sof_probe_cb(uint32_t frame_number);
+
+#define SIM_FRAME_NS        1000000     // full speed, one iso packet per 1 ms frame
+#define SIM_ARRIVAL_NS      100000      // nominal end of the OUT transfer after SOF
+#define SIM_TONE_HZ         997.0
+#define SIM_TONE_DBFS       -6.0
+#define SIM_PATTERN_LEADIN  20          // packets of silence before the pattern, while the gain ramps to unity
+
+typedef struct {
+    uint32_t rate;
+    uint32_t bits;
+    double seconds;
+    uint32_t jitter_us;
+    double loss_percent;
+    double drift_ppm;
+    uint32_t buffers;
+    uint32_t frames;
+    uint32_t seed;
+    long max_underruns;
+    long max_block_us;
+    int overrun;                // audio_overrun_policy_t, -1 for the configured one
+    int siggen;                 // siggen_signal_t fed through siggen_step(), -1 for the USB path
+    bool pattern;               // send the verify.h counter pattern instead of the tone
+    bool verbose;
+} sim_options_t;
+
+typedef struct {
+    uint32_t packets;
+    uint32_t lost;
+    uint32_t late;              // handled after the next packet was due, the USB task fell behind
+    uint32_t failed;            // audio_write() errors
+    int64_t block_max_ns;       // longest packet callback, what the USB task waited in it
+    uint64_t audio_frames;
+    uint64_t fill_sum;
+    uint32_t fill_min;
+    uint32_t fill_max;
+    uint64_t *cpu_ns;           // host CPU time per packet
+    uint32_t pattern_next;      // counter of the next pattern frame the host sends
+    bool pattern_locked;
+    verify_summary_t expected;  // what the verifier must report for the packets delivered
+} sim_result_t;
+
+static sim_options_t mOptions = {
+    .rate = 48000,
+    .bits = 16,
+    .seconds = 10,
+    .max_underruns = -1,
+    .max_block_us = -1,
+    .overrun = -1,
+    .seed = 1,
+    .siggen = -1,
+};
+
+static void sim_usage(const char *name)
+{
+    printf("Usage: %s [options]\n"
+           "  --rate HZ          sample rate: 44100, 48000, 88200 or 96000 (default 48000)\n"
+           "  --bits N           16 or 24 (default 16)\n"
+           "  --seconds S        simulated stream length (default 10)\n"
+           "  --jitter US        packet arrival jitter, uniform 0..US (default 0)\n"
+           "  --loss PCT         lost packets in percent (default 0)\n"
+           "  --drift PPM        host sample clock offset against the I2S clock (default 0)\n"
+           "  --buffers N        DMA buffer count, see audio_set_dma_buffers()\n"
+           "  --frames N         frames per DMA buffer\n"
+           "  --seed N           random seed (default 1)\n"
+           "  --max-underruns N  fail when the stream had more underruns\n"
+           "  --max-block-us US  fail when a packet held the USB task longer\n"
+           "  --overrun POLICY   drop-newest, drop-oldest or stretch (default from sdkconfig)\n"
+           "  --pattern          send the bit-perfect verification pattern at full volume\n"
+           "                     and check the verifier's counters and CRC against it\n"
+           "  --siggen SIGNAL    play sine, sweep or noise from the test signal generator\n"
+           "                     instead of USB packets, jitter, loss and drift do not apply\n"
+           "  -v, --verbose      firmware logs down to debug level\n", name);
+}
+
+static bool sim_parse_options(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"rate", required_argument, NULL, 'r'},
+        {"bits", required_argument, NULL, 'b'},
+        {"seconds", required_argument, NULL, 's'},
+        {"jitter", required_argument, NULL, 'j'},
+        {"loss", required_argument, NULL, 'l'},
+        {"drift", required_argument, NULL, 'd'},
+        {"buffers", required_argument, NULL, 'n'},
+        {"frames", required_argument, NULL, 'f'},
+        {"seed", required_argument, NULL, 'S'},
+        {"max-underruns", required_argument, NULL, 'u'},
+        {"max-block-us", required_argument, NULL, 'B'},
+        {"overrun", required_argument, NULL, 'o'},
+        {"siggen", required_argument, NULL, 'g'},
+        {"pattern", no_argument, NULL, 'p'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {0},
+    };
+
+    int opt;
+    while((opt = getopt_long(argc, argv, "vh", options, NULL)) != -1) {
+        switch(opt) {
+        case 'r': mOptions.rate = strtoul(optarg, NULL, 0); break;
+        case 'b': mOptions.bits = strtoul(optarg, NULL, 0); break;
+        case 's': mOptions.seconds = strtod(optarg, NULL); break;
+        case 'j': mOptions.jitter_us = strtoul(optarg, NULL, 0); break;
+        case 'l': mOptions.loss_percent = strtod(optarg, NULL); break;
+        case 'd': mOptions.drift_ppm = strtod(optarg, NULL); break;
+        case 'n': mOptions.buffers = strtoul(optarg, NULL, 0); break;
+        case 'f': mOptions.frames = strtoul(optarg, NULL, 0); break;
+        case 'S': mOptions.seed = strtoul(optarg, NULL, 0); break;
+        case 'u': mOptions.max_underruns = strtol(optarg, NULL, 0); break;
+        case 'B': mOptions.max_block_us = strtol(optarg, NULL, 0); break;
+        case 'o':
+            for(int i = 0; i < AUDIO_OVERRUN_MAX; i++) {
+                if(strcmp(optarg, audio_overrun_policy_name(i)) == 0) mOptions.overrun = i;
+            }
+            if(mOptions.overrun < 0) return false;
+            break;
+        case 'g':
+            for(int i = 0; i < SIGGEN_MAX; i++) {
+                if(strcmp(optarg, siggen_signal_name(i)) == 0) mOptions.siggen = i;
+            }
+            if(mOptions.siggen < 0) return false;
+            break;
+        case 'p': mOptions.pattern = true; break;
+        case 'v': mOptions.verbose = true; break;
+        default: return false;
+        }
+    }
+    if(mOptions.bits != 16 && mOptions.bits != 24) return false;
+    if(mOptions.rate != 44100 && mOptions.rate != 48000 && mOptions.rate != 88200 && mOptions.rate != 96000) return false;
+    if((mOptions.buffers == 0) != (mOptions.frames == 0)) return false;
+    return mOptions.seconds > 0;
+}
+
+static uint64_t sim_cpu_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Set the sample rate and open the streaming interface the way the host does
+*/
+static bool sim_stream_open(uint8_t alt)
+{
+    audio_control_request_t request = {
+        .bmRequestType = 0x21,
+        .bRequest = AUDIO_CS_REQ_CUR,
+        .bControlSelector = AUDIO_CS_CTRL_SAM_FREQ,
+        .bEntityID = UAC2_ENTITY_CLOCK,
+        .wLength = sizeof(audio_control_cur_4_t),
+    };
+    audio_control_cur_4_t rate = {.bCur = mOptions.rate};
+    if(!tud_audio_set_req_entity_cb(0, (tusb_control_request_t const *)&request, (uint8_t *)&rate)) return false;
+
+    tusb_control_request_t set_itf = {
+        .bmRequestType = 0x01,
+        .bRequest = TUSB_REQ_SET_INTERFACE,
+        .wValue = alt,
+        .wIndex = ITF_NUM_AUDIO_STREAMING_SPK,
+    };
+    return tud_audio_set_itf_cb(0, &set_itf);
+}
+
+static void sim_stream_close()
+{
+    tusb_control_request_t set_itf = {
+        .bmRequestType = 0x01,
+        .bRequest = TUSB_REQ_SET_INTERFACE,
+        .wValue = 0,
+        .wIndex = ITF_NUM_AUDIO_STREAMING_SPK,
+    };
+    tud_audio_set_itf_close_EP_cb(0, &set_itf);
+}
+
+/**
+ * @brief Ask the output terminal for its latency, as a host would before starting playback
+*/
+static uint32_t sim_get_latency_ns()
+{
+    audio_control_request_t request = {
+        .bmRequestType = 0xa1,
+        .bRequest = AUDIO_CS_REQ_CUR,
+        .bControlSelector = AUDIO_TE_CTRL_LATENCY,
+        .bEntityID = UAC2_ENTITY_SPK_OUTPUT_TERMINAL,
+        .wLength = sizeof(audio_control_cur_4_t),
+    };
+    audio_control_cur_4_t latency = {0};
+    if(!tud_audio_get_req_entity_cb(0, (tusb_control_request_t const *)&request)) return 0;
+    mock_tusb_get_control_response(&latency, sizeof(latency));
+    return latency.bCur;
+}
+
+/**
+ * @brief Fill a packet with a stereo tone in the USB slot format
+*/
+static void sim_fill_packet(void *packet, uint32_t frames, uint8_t slot_bytes, double *phase)
+{
+    const double amplitude = pow(10, SIM_TONE_DBFS / 20);
+    const double step = 2 * M_PI * SIM_TONE_HZ / mOptions.rate;
+
+    for(uint32_t i = 0; i < frames; i++) {
+        double value = amplitude * sin(*phase);
+        *phase += step;
+        if(slot_bytes == 2) {
+            int16_t sample = value * INT16_MAX;
+            ((int16_t *)packet)[2 * i] = ((int16_t *)packet)[2 * i + 1] = sample;
+        } else {
+            // 24 bit in the upper bits of the 32 bit slot
+            int32_t sample = (int32_t)(value * 0x7fffff) << 8;
+            ((int32_t *)packet)[2 * i] = ((int32_t *)packet)[2 * i + 1] = sample;
+        }
+    }
+    *phase = fmod(*phase, 2 * M_PI);
+}
+
+/**
+ * @brief Set the master volume to the maximum, the software gain is unity there
+*/
+static bool sim_set_full_volume()
+{
+    audio_control_request_t request = {
+        .bmRequestType = 0x21,
+        .bRequest = AUDIO_CS_REQ_CUR,
+        .bControlSelector = AUDIO_FU_CTRL_VOLUME,
+        .bChannelNumber = 0,
+        .bEntityID = UAC2_ENTITY_SPK_FEATURE_UNIT,
+        .wLength = sizeof(audio_control_cur_2_t),
+    };
+    audio_control_cur_2_t volume = {.bCur = (USB_VOLUME_MAX + USB_VOLUME_OFFSET) * 256};
+    return tud_audio_set_req_entity_cb(0, (tusb_control_request_t const *)&request, (uint8_t *)&volume);
+}
+
+/**
+ * @brief Fill a packet with the verification pattern from a frame counter
+*/
+static void sim_fill_pattern(void *packet, uint32_t frames, uint8_t slot_bytes, uint32_t counter)
+{
+    const uint32_t mask = (1UL << mOptions.bits) - 1;
+    for(uint32_t i = 0; i < frames; i++) {
+        uint32_t left = (counter + i) & mask;
+        uint32_t right = verify_pattern_check(left, mOptions.bits);
+        if(slot_bytes == 2) {
+            ((int16_t *)packet)[2 * i] = left;
+            ((int16_t *)packet)[2 * i + 1] = right;
+        } else {
+            ((int32_t *)packet)[2 * i] = left << 8;
+            ((int32_t *)packet)[2 * i + 1] = right << 8;
+        }
+    }
+}
+
+/**
+ * @brief Account a delivered pattern packet to the summary the verifier must end up with
+*/
+static void sim_expect_pattern(verify_summary_t *expected, bool *locked, uint32_t counter, uint32_t frames)
+{
+    const uint32_t mask = (1UL << mOptions.bits) - 1;
+    const uint32_t sample_bytes = mOptions.bits / 8;
+    static uint8_t pcm[CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ];
+
+    if(!*locked) {
+        *locked = true;
+        expected->first = counter & mask;
+    } else {
+        expected->dropped += counter - (expected->first + expected->frames + expected->dropped);
+    }
+    expected->frames += frames;
+
+    // Packed little endian samples, the I2S layout at unity gain
+    uint8_t *p = pcm;
+    for(uint32_t i = 0; i < frames; i++) {
+        uint32_t left = (counter + i) & mask;
+        uint32_t samples[2] = {left, verify_pattern_check(left, mOptions.bits)};
+        for(int ch = 0; ch < 2; ch++) {
+            for(uint32_t b = 0; b < sample_bytes; b++) *p++ = samples[ch] >> (8 * b);
+        }
+    }
+    expected->crc = esp_rom_crc32_le(expected->crc, pcm, p - pcm);
+}
+
+static int sim_compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void sim_run(sim_result_t *result)
+{
+    const uint8_t alt = mOptions.bits == 16 ? 1 : 2;
+    const uint8_t slot_bytes = alt == 1 ? CFG_TUD_AUDIO_FUNC_1_FORMAT_1_N_BYTES_PER_SAMPLE_RX : CFG_TUD_AUDIO_FUNC_1_FORMAT_2_N_BYTES_PER_SAMPLE_RX;
+    const uint32_t total = mOptions.seconds * 1000;
+    // Frames the host sends per USB frame, with its clock offset
+    const double frames_per_packet = mOptions.rate * (1 + mOptions.drift_ppm / 1e6) / 1000;
+
+    static uint8_t packet[CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ];
+    double frame_acc = 0, phase = 0;
+
+    result->cpu_ns = calloc(total, sizeof(uint64_t));
+    result->fill_min = UINT32_MAX;
+
+    int64_t start = sim_now_ns();
+    for(uint32_t k = 0; k < total; k++) {
+        int64_t sof = start + (int64_t)k * SIM_FRAME_NS;
+        sim_advance_to(sof);
+#if CONFIG_AUDIO_LATENCY
+        tud_dcd_sof_probe_cb(k & 0x7ff);
+#endif
+
+        frame_acc += frames_per_packet;
+        uint32_t frames = frame_acc;
+        frame_acc -= frames;
+
+        // The pattern counts every frame the host sends, lost or not
+        bool pattern = mOptions.pattern && k >= SIM_PATTERN_LEADIN;
+        uint32_t counter = result->pattern_next;
+        if(pattern) result->pattern_next += frames;
+
+        if(rand() < mOptions.loss_percent / 100 * RAND_MAX) {
+            result->lost++;
+            continue;
+        }
+
+        int64_t arrival = sof + SIM_ARRIVAL_NS;
+        if(mOptions.jitter_us) arrival += (int64_t)(rand() % (mOptions.jitter_us + 1)) * 1000;
+        if(sim_now_ns() > sof + SIM_FRAME_NS) result->late++;
+        sim_advance_to(arrival);
+
+        uint16_t size = frames * slot_bytes * CFG_TUD_AUDIO_FUNC_1_N_CHANNELS_RX;
+        if(pattern) {
+            sim_fill_pattern(packet, frames, slot_bytes, counter);
+            sim_expect_pattern(&result->expected, &result->pattern_locked, counter, frames);
+        } else if(mOptions.pattern) {
+            memset(packet, 0, frames * slot_bytes * CFG_TUD_AUDIO_FUNC_1_N_CHANNELS_RX);
+        } else {
+            sim_fill_packet(packet, frames, slot_bytes, &phase);
+        }
+        mock_tusb_set_rx(packet, size);
+
+        uint64_t cpu = sim_cpu_ns();
+        int64_t begin = sim_now_ns();
+        if(!tud_audio_rx_done_pre_read_cb(0, size, 0, 0x01, alt)) result->failed++;
+        result->cpu_ns[result->packets++] = sim_cpu_ns() - cpu;
+        if(sim_now_ns() - begin > result->block_max_ns) result->block_max_ns = sim_now_ns() - begin;
+        result->audio_frames += frames;
+
+        audio_stats_t stats;
+        audio_get_stats(&stats);
+        if(stats.buffer_fill < result->fill_min) result->fill_min = stats.buffer_fill;
+        if(stats.buffer_fill > result->fill_max) result->fill_max = stats.buffer_fill;
+        result->fill_sum += stats.buffer_fill;
+    }
+}
+
+/**
+ * @brief Play packets from the test signal generator, as its task does on the device
+ *
+ * There is no host clock, the writes block on the DMA buffers and pace the stream.
+*/
+static void sim_run_siggen(sim_result_t *result)
+{
+    const uint32_t total = mOptions.seconds * 1000;
+    result->cpu_ns = calloc(total, sizeof(uint64_t));
+    result->fill_min = UINT32_MAX;
+
+    uint64_t frames_before = 0;
+    for(uint32_t k = 0; k < total; k++) {
+        uint64_t cpu = sim_cpu_ns();
+        if(siggen_step() != ESP_OK) result->failed++;
+        result->cpu_ns[result->packets++] = sim_cpu_ns() - cpu;
+
+        // 1 ms of audio per packet, with the same remainder carry as the generator
+        uint64_t frames = (uint64_t)(k + 1) * mOptions.rate / 1000;
+        result->audio_frames += frames - frames_before;
+        frames_before = frames;
+
+        audio_stats_t stats;
+        audio_get_stats(&stats);
+        if(stats.buffer_fill < result->fill_min) result->fill_min = stats.buffer_fill;
+        if(stats.buffer_fill > result->fill_max) result->fill_max = stats.buffer_fill;
+        result->fill_sum += stats.buffer_fill;
+    }
+}
+
+static void sim_report_stages()
+{
+    // The mock cycle counter runs at 1 GHz, cycles read as ns
+    static const profile_stage_t stages[] = {PROFILE_STAGE_GENERATE, PROFILE_STAGE_CONVERT, PROFILE_STAGE_I2S_WRITE};
+    static const char* const names[] = {"generate", "convert", "i2s write"};
+    for(int i = 0; i < sizeof(stages) / sizeof(stages[0]); i++) {
+        profile_summary_t s;
+        profile_get_summary(stages[i], &s);
+        printf("%-11s min %lu avg %lu p99 %lu max %lu ns\n", names[i],
+                (unsigned long)s.min, (unsigned long)s.avg, (unsigned long)s.p99, (unsigned long)s.max);
+    }
+}
+
+/**
+ * @brief Compare the verifier against what was delivered, as tools/verify.py does with the device
+ *
+ * Frames the overrun policy gave up must show as dropped, a stretched frame as one
+ * dropped and one corrupted. Which frames went is up to the policy, the CRC is only
+ * compared when none did. Frames given up at the very end have no later frame to
+ * reveal them, the counts are upper bounds then.
+*/
+static bool sim_report_verify(const sim_result_t *result, const audio_stats_t *stats)
+{
+    verify_summary_t s;
+    verify_get_summary(&s);
+    verify_summary_t expected = result->expected;
+    const verify_summary_t *e = &expected;
+    uint32_t given_up = stats->dropped_bytes / (2 * mOptions.bits / 8) + stats->stretched_frames;
+    if(given_up) {
+        expected.frames -= given_up;
+        expected.dropped += given_up;
+        expected.corrupted += stats->stretched_frames;
+        expected.crc = s.crc;
+    }
+    printf("verify      %lu frames from %lu, crc %08lx, %lu dropped, %lu duplicated, %lu corrupted\n",
+            (unsigned long)s.frames, (unsigned long)s.first, (unsigned long)s.crc,
+            (unsigned long)s.dropped, (unsigned long)s.duplicated, (unsigned long)s.corrupted);
+    bool match = memcmp(&s, e, sizeof(s)) == 0;
+    if(given_up) {
+        match = s.first == e->first && s.frames == e->frames && s.duplicated == e->duplicated &&
+                s.dropped <= e->dropped && s.corrupted <= e->corrupted;
+    }
+    if(!match) {
+        printf("expected    %lu frames from %lu, crc %08lx, %lu dropped, %lu duplicated, %lu corrupted\n",
+                (unsigned long)e->frames, (unsigned long)e->first, (unsigned long)e->crc,
+                (unsigned long)e->dropped, (unsigned long)e->duplicated, (unsigned long)e->corrupted);
+    }
+    return match;
+}
+
+static void sim_report(sim_result_t *result, audio_stats_t *stats, uint32_t latency_ns)
+{
+    mock_i2s_stats_t i2s;
+    mock_i2c_stats_t i2c;
+    mock_i2s_get_stats(&i2s);
+    mock_i2c_get_stats(&i2c);
+
+    uint64_t cpu_total = 0;
+    for(uint32_t i = 0; i < result->packets; i++) cpu_total += result->cpu_ns[i];
+    qsort(result->cpu_ns, result->packets, sizeof(uint64_t), sim_compare_u64);
+    uint32_t n = result->packets ? result->packets : 1;
+    uint32_t bytes_per_frame = 2 * mOptions.bits / 8;
+
+    if(mOptions.siggen >= 0) {
+        printf("stream      %lu Hz %lu bit, %.1f s, %s from the test signal generator\n",
+                (unsigned long)mOptions.rate, (unsigned long)mOptions.bits, mOptions.seconds, siggen_signal_name(mOptions.siggen));
+    } else {
+        printf("stream      %lu Hz %lu bit, %.1f s, jitter %lu us, loss %.2f%%, drift %+.1f ppm\n",
+                (unsigned long)mOptions.rate, (unsigned long)mOptions.bits, mOptions.seconds,
+                (unsigned long)mOptions.jitter_us, mOptions.loss_percent, mOptions.drift_ppm);
+    }
+    printf("dma         %lu bytes buffered\n", (unsigned long)stats->buffer_size);
+    printf("packets     %lu handled, %lu lost, %lu late, %lu failed\n",
+            (unsigned long)result->packets, (unsigned long)result->lost, (unsigned long)result->late, (unsigned long)result->failed);
+    printf("throughput  %.1f MB/s of PCM, %.0fx real time\n",
+            cpu_total ? result->audio_frames * bytes_per_frame * 1e3 / cpu_total : 0,
+            cpu_total ? mOptions.seconds * 1e9 / cpu_total : 0);
+    printf("cpu/packet  min %llu avg %llu p99 %llu max %llu ns, %.2f ns per frame\n",
+            (unsigned long long)result->cpu_ns[0], (unsigned long long)(cpu_total / n),
+            (unsigned long long)result->cpu_ns[(uint64_t)n * 99 / 100], (unsigned long long)result->cpu_ns[n - 1],
+            result->audio_frames ? (double)cpu_total / result->audio_frames : 0);
+    printf("buffer      fill min %lu avg %llu max %lu bytes, writer blocked %.1f ms in %lu writes\n",
+            (unsigned long)result->fill_min, (unsigned long long)(result->fill_sum / n), (unsigned long)result->fill_max,
+            i2s.blocked_ns / 1e6, (unsigned long)i2s.blocked_writes);
+    if(mOptions.siggen < 0) printf("usb task    held at most %lld us by a packet\n", (long long)(result->block_max_ns / 1000));
+    printf("underruns   %lu, %lu frames concealed, %lu overruns\n",
+            (unsigned long)stats->underruns, (unsigned long)stats->concealed_frames, (unsigned long)stats->overruns);
+    printf("overrun     %lu bytes dropped, %lu frames stretched\n",
+            (unsigned long)stats->dropped_bytes, (unsigned long)stats->stretched_frames);
+    if(mOptions.siggen >= 0) sim_report_stages();
+#if CONFIG_AUDIO_LATENCY
+    latency_summary_t latency;
+    latency_get_summary(&latency);
+    // Without SOFs from a host there is nothing to measure against
+    if(mOptions.siggen < 0) printf("latency     min %lu avg %lu p50 %lu p99 %lu max %lu us, reported %lu us\n",
+            (unsigned long)latency.min_us, (unsigned long)latency.avg_us, (unsigned long)latency.p50_us,
+            (unsigned long)latency.p99_us, (unsigned long)latency.max_us, (unsigned long)(latency_ns / 1000));
+#endif
+    printf("i2c         %lu writes, %lu reads\n", (unsigned long)i2c.writes, (unsigned long)i2c.reads);
+}
+
+int main(int argc, char **argv)
+{
+    if(!sim_parse_options(argc, argv)) {
+        sim_usage(argv[0]);
+        return 2;
+    }
+    srand(mOptions.seed);
+    esp_log_level_set("*", mOptions.verbose ? ESP_LOG_DEBUG : ESP_LOG_WARN);
+
+    ESP_ERROR_CHECK(settings_init());
+    ESP_ERROR_CHECK(audio_init());
+    ESP_ERROR_CHECK(usb_init());
+    if(mOptions.buffers) ESP_ERROR_CHECK(audio_set_dma_buffers(mOptions.buffers, mOptions.frames));
+    if(mOptions.overrun >= 0) ESP_ERROR_CHECK(audio_set_overrun_policy(mOptions.overrun));
+
+    tud_mount_cb();
+    sim_result_t result = {0};
+    if(mOptions.siggen >= 0) {
+        siggen_config_t config = {
+            .signal = mOptions.siggen,
+            .sample_rate_hz = mOptions.rate,
+            .bits_per_sample = mOptions.bits,
+        };
+        ESP_ERROR_CHECK(siggen_start(&config));
+        sim_run_siggen(&result);
+    } else {
+        if(mOptions.pattern && !sim_set_full_volume()) {
+            fprintf(stderr, "set volume failed\n");
+            return 1;
+        }
+        if(!sim_stream_open(mOptions.bits == 16 ? 1 : 2)) {
+            fprintf(stderr, "stream open failed\n");
+            return 1;
+        }
+        sim_run(&result);
+    }
+
+    audio_stats_t stats;
+    audio_get_stats(&stats);
+    uint32_t latency_ns = sim_get_latency_ns();
+    if(mOptions.siggen >= 0) {
+        ESP_ERROR_CHECK(siggen_stop());
+    } else {
+        // The data still pending plays out, as the packets after the last one would push it
+        static uint8_t none[1];
+        ESP_ERROR_CHECK(audio_write(0, none, AUDIO_WAIT_FOREVER));
+        sim_stream_close();
+    }
+    sim_report(&result, &stats, latency_ns);
+    bool verified = !mOptions.pattern || sim_report_verify(&result, &stats);
+    free(result.cpu_ns);
+
+    if(result.failed || !verified) return 1;
+    if(mOptions.max_underruns >= 0 && stats.underruns > mOptions.max_underruns) {
+        fprintf(stderr, "%lu underruns, at most %ld allowed\n", (unsigned long)stats.underruns, mOptions.max_underruns);
+        return 1;
+    }
+    if(mOptions.max_block_us >= 0 && result.block_max_ns > mOptions.max_block_us * 1000LL) {
+        fprintf(stderr, "USB task held %lld us by a packet, at most %ld allowed\n", (long long)(result.block_max_ns / 1000), mOptions.max_block_us);
+        return 1;
+    }
+    return 0;
+}
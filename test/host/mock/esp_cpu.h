@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Host CPU time in nanoseconds, so profile.c reports ns instead of cycles in the simulation
+*/
+uint32_t esp_cpu_get_cycle_count(void);
+int esp_cpu_get_core_id(void);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef enum { USB_PHY_CTRL_OTG, USB_PHY_CTRL_SERIAL_JTAG } usb_phy_controller_t;
+typedef enum { USB_OTG_MODE_HOST, USB_OTG_MODE_DEVICE } usb_otg_mode_t;
+typedef enum { USB_PHY_TARGET_INT, USB_PHY_TARGET_EXT } usb_phy_target_t;
+
+typedef struct {
+    usb_phy_controller_t controller;
+    usb_phy_target_t target;
+    usb_otg_mode_t otg_mode;
+} usb_phy_config_t;
+
+typedef struct phy_context_t *usb_phy_handle_t;
+
+esp_err_t usb_new_phy(const usb_phy_config_t *config, usb_phy_handle_t *handle_ret);
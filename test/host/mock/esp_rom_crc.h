@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief CRC32 as in the ROM, zlib compatible when chained from 0
+*/
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "esp_attr.h"
+
+/**
+ * The simulation is single threaded: critical sections and semaphores never block,
+ * and tasks are not started. Only what the firmware and the TinyUSB OSAL use is declared.
+*/
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+// Storage of the static create functions, never looked into
+typedef struct {
+    int dummy;
+} StaticTask_t;
+typedef StaticTask_t StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS      (1000 / CONFIG_FREERTOS_HZ)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)((uint64_t)(ms) * CONFIG_FREERTOS_HZ / 1000))
+#define configSUPPORT_STATIC_ALLOCATION 0
+#define configMAX_PRIORITIES    25
+
+typedef struct {
+    int count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    {0}
+#define portENTER_CRITICAL(mux)         ((mux)->count++)
+#define portEXIT_CRITICAL(mux)          ((mux)->count--)
+#define portENTER_CRITICAL_ISR(mux)     portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux)      portEXIT_CRITICAL(mux)
+#define portYIELD_FROM_ISR(...)
+#define xPortInIsrContext()             0
@@ -0,0 +1,482 @@
+#include "sim.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_event.h"
+#include "reactor.h"
+#include "events.h"
+#include "esp_cpu.h"
+#include "esp_rom_crc.h"
+#include "nvs_flash.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+//--------------------------------------------------------------------+
+// Simulated clock
+//--------------------------------------------------------------------+
+
+#define MOCK_TIMERS     16
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    bool armed;
+    int64_t expiry_ns;
+    int64_t period_ns;
+};
+
+static int64_t mNowNs = 0;
+static struct esp_timer mTimers[MOCK_TIMERS];
+static int mTimerCount = 0;
+
+int64_t sim_now_ns(void)
+{
+    return mNowNs;
+}
+
+void sim_advance_to(int64_t ns)
+{
+    while(1) {
+        int64_t next = mock_i2s_next_event_ns();
+        struct esp_timer *timer = NULL;
+        for(int i = 0; i < mTimerCount; i++) {
+            if(mTimers[i].armed && mTimers[i].expiry_ns < next) {
+                next = mTimers[i].expiry_ns;
+                timer = &mTimers[i];
+            }
+        }
+        if(next > ns) break;
+
+        if(next > mNowNs) mNowNs = next;
+        if(timer) {
+            timer->armed = timer->period_ns > 0;
+            timer->expiry_ns += timer->period_ns;
+            timer->callback(timer->arg);
+        } else {
+            mock_i2s_run_event();
+        }
+    }
+    if(ns > mNowNs) mNowNs = ns;
+}
+
+//--------------------------------------------------------------------+
+// esp_timer
+//--------------------------------------------------------------------+
+
+int64_t esp_timer_get_time(void)
+{
+    return mNowNs / 1000;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    if(mTimerCount == MOCK_TIMERS) return ESP_ERR_NO_MEM;
+    struct esp_timer *timer = &mTimers[mTimerCount++];
+    *timer = (struct esp_timer) {
+        .callback = create_args->callback,
+        .arg = create_args->arg,
+        .name = create_args->name,
+    };
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if(timer->armed) return ESP_ERR_INVALID_STATE;
+    timer->armed = true;
+    timer->expiry_ns = mNowNs + timeout_us * 1000;
+    timer->period_ns = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    if(timer->armed) return ESP_ERR_INVALID_STATE;
+    timer->armed = true;
+    timer->period_ns = period * 1000;
+    timer->expiry_ns = mNowNs + timer->period_ns;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if(!timer->armed) return ESP_ERR_INVALID_STATE;
+    timer->armed = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    timer->armed = false;
+    timer->callback = NULL;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer->armed;
+}
+
+//--------------------------------------------------------------------+
+// esp_event
+//--------------------------------------------------------------------+
+
+#define MOCK_EVENT_HANDLERS 8
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} mock_event_handler_t;
+
+static mock_event_handler_t mHandlers[MOCK_EVENT_HANDLERS];
+static int mHandlerCount = 0;
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    if(mHandlerCount == MOCK_EVENT_HANDLERS) return ESP_ERR_NO_MEM;
+    mHandlers[mHandlerCount++] = (mock_event_handler_t) {event_base, event_id, event_handler, event_handler_arg};
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    for(int i = 0; i < mHandlerCount; i++) {
+        mock_event_handler_t *h = &mHandlers[i];
+        if((h->base == ESP_EVENT_ANY_BASE || h->base == event_base) && (h->id == ESP_EVENT_ANY_ID || h->id == event_id)) {
+            h->handler(h->arg, event_base, event_id, (void *)event_data);
+        }
+    }
+    return ESP_OK;
+}
+
+//--------------------------------------------------------------------+
+// reactor, calls run synchronously like the esp_event mock
+//--------------------------------------------------------------------+
+
+esp_err_t reactor_init()
+{
+    return ESP_OK;
+}
+
+bool reactor_call(reactor_fn_t fn, void *arg, uint32_t value)
+{
+    fn(arg, value);
+    return true;
+}
+
+bool reactor_call_from_isr(reactor_fn_t fn, void *arg, uint32_t value, BaseType_t *woken)
+{
+    fn(arg, value);
+    return true;
+}
+
+void reactor_wake()
+{
+}
+
+void reactor_wake_from_isr(BaseType_t *woken)
+{
+}
+
+//--------------------------------------------------------------------+
+// events, dispatched synchronously from the post
+//--------------------------------------------------------------------+
+
+static mock_event_handler_t mSubscribers[MOCK_EVENT_HANDLERS];
+static events_handler_t mSubscriberHandlers[MOCK_EVENT_HANDLERS];
+static int mSubscriberCount = 0;
+
+void events_init()
+{
+}
+
+esp_err_t events_subscribe(esp_event_base_t base, int32_t id, events_handler_t handler, void *arg)
+{
+    if(mSubscriberCount == MOCK_EVENT_HANDLERS) return ESP_ERR_NO_MEM;
+    mSubscribers[mSubscriberCount] = (mock_event_handler_t) {base, id, NULL, arg};
+    mSubscriberHandlers[mSubscriberCount++] = handler;
+    return ESP_OK;
+}
+
+bool events_post(esp_event_base_t base, int32_t id)
+{
+    event_t event = {.base = base, .id = id};
+    return events_post_event(&event);
+}
+
+bool events_post_event(event_t *event)
+{
+    event->posted_us = esp_timer_get_time();
+    for(int i = 0; i < mSubscriberCount; i++) {
+        mock_event_handler_t *s = &mSubscribers[i];
+        if((s->base == ESP_EVENT_ANY_BASE || s->base == event->base) && (s->id == ESP_EVENT_ANY_ID || s->id == event->id)) {
+            mSubscriberHandlers[i](event, s->arg);
+        }
+    }
+    return true;
+}
+
+bool events_post_event_from_isr(event_t *event, BaseType_t *woken)
+{
+    return events_post_event(event);
+}
+
+int events_dispatch()
+{
+    return 0;
+}
+
+void events_get_stats(events_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+//--------------------------------------------------------------------+
+// esp_log, esp_err, esp_cpu, esp_rom
+//--------------------------------------------------------------------+
+
+static esp_log_level_t mLogLevel = ESP_LOG_INFO;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    mLogLevel = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char LETTERS[] = "NEWIDV";
+    if(level > mLogLevel) return;
+
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%c (%lld) %s: ", LETTERS[level], (long long)(mNowNs / 1000000), tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch(code) {
+    case ESP_OK:                    return "ESP_OK";
+    case ESP_FAIL:                  return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NVS_NOT_FOUND:     return "ESP_ERR_NVS_NOT_FOUND";
+    default:                        return "UNKNOWN ERROR";
+    }
+}
+
+uint32_t esp_cpu_get_cycle_count(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+int esp_cpu_get_core_id(void)
+{
+    return 1;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    crc = ~crc;
+    while(len--) {
+        crc ^= *buf++;
+        for(int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+//--------------------------------------------------------------------+
+// NVS, one blob per key in a single namespace
+//--------------------------------------------------------------------+
+
+#define MOCK_NVS_KEYS       4
+#define MOCK_NVS_BLOB_SIZE  64
+
+typedef struct {
+    char key[16];
+    uint8_t value[MOCK_NVS_BLOB_SIZE];
+    size_t length;
+} mock_nvs_entry_t;
+
+static mock_nvs_entry_t mNvs[MOCK_NVS_KEYS];
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    memset(mNvs, 0, sizeof(mNvs));
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+static mock_nvs_entry_t *nvs_find(const char *key, bool create)
+{
+    for(int i = 0; i < MOCK_NVS_KEYS; i++) {
+        if(strncmp(mNvs[i].key, key, sizeof(mNvs[i].key)) == 0) return &mNvs[i];
+    }
+    if(!create) return NULL;
+    for(int i = 0; i < MOCK_NVS_KEYS; i++) {
+        if(mNvs[i].key[0] == 0) {
+            strncpy(mNvs[i].key, key, sizeof(mNvs[i].key) - 1);
+            return &mNvs[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    if(length > MOCK_NVS_BLOB_SIZE) return ESP_ERR_INVALID_SIZE;
+    mock_nvs_entry_t *entry = nvs_find(key, true);
+    if(!entry) return ESP_ERR_NO_MEM;
+    memcpy(entry->value, value, length);
+    entry->length = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    mock_nvs_entry_t *entry = nvs_find(key, false);
+    if(!entry) return ESP_ERR_NVS_NOT_FOUND;
+    if(*length < entry->length) return ESP_ERR_INVALID_SIZE;
+    memcpy(out_value, entry->value, entry->length);
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+//--------------------------------------------------------------------+
+// FreeRTOS, single threaded
+//--------------------------------------------------------------------+
+
+struct sim_queue {
+    int dummy;
+};
+
+static struct sim_queue mSemaphore;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char *pcName, uint32_t usStackDepth,
+        void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pvCreatedTask, BaseType_t xCoreID)
+{
+    // Tasks are driven by the simulation loop instead
+    if(pvCreatedTask) *pvCreatedTask = NULL;
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t pvTaskCode, const char *pcName, uint32_t ulStackDepth,
+        void *pvParameters, UBaseType_t uxPriority, StackType_t *puxStackBuffer, StaticTask_t *pxTaskBuffer, BaseType_t xCoreID)
+{
+    return NULL;
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    sim_advance_to(mNowNs + (int64_t)xTicksToDelay * portTICK_PERIOD_MS * 1000000);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return mNowNs / (portTICK_PERIOD_MS * 1000000LL);
+}
+
+char *pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    return "sim";
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return NULL;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+}
+
+BaseType_t xTaskNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction)
+{
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit, uint32_t *pulNotificationValue, TickType_t xTicksToWait)
+{
+    if(pulNotificationValue) *pulNotificationValue = 1;
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return &mSemaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return &mSemaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *pxMutexBuffer)
+{
+    return &mSemaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *pxSemaphoreBuffer)
+{
+    return &mSemaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime)
+{
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore)
+{
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t xSemaphore, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore)
+{
+}
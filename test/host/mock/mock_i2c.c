@@ -0,0 +1,90 @@
+#include "sim.h"
+#include "i2c_bus.h"
+#include <stdlib.h>
+
+/**
+ * I2C bus with one register file per device, transactions always succeed
+*/
+typedef struct {
+    uint32_t clk_speed;
+} mock_i2c_bus_t;
+
+typedef struct {
+    uint8_t addr;
+    uint8_t regs[256];
+} mock_i2c_device_t;
+
+static mock_i2c_stats_t mStats;
+
+i2c_bus_handle_t i2c_bus_create(i2c_port_t port, const i2c_config_t *conf)
+{
+    mock_i2c_bus_t *bus = calloc(1, sizeof(*bus));
+    bus->clk_speed = conf->master.clk_speed;
+    return bus;
+}
+
+uint32_t i2c_bus_get_current_clk_speed(i2c_bus_handle_t bus_handle)
+{
+    return ((mock_i2c_bus_t *)bus_handle)->clk_speed;
+}
+
+i2c_bus_device_handle_t i2c_bus_device_create(i2c_bus_handle_t bus_handle, uint8_t dev_addr, uint32_t clk_speed)
+{
+    mock_i2c_device_t *device = calloc(1, sizeof(*device));
+    device->addr = dev_addr;
+    return device;
+}
+
+esp_err_t i2c_bus_read_byte(i2c_bus_device_handle_t dev_handle, uint8_t mem_address, uint8_t *data)
+{
+    mStats.reads++;
+    *data = ((mock_i2c_device_t *)dev_handle)->regs[mem_address];
+    return ESP_OK;
+}
+
+esp_err_t i2c_bus_write_byte(i2c_bus_device_handle_t dev_handle, uint8_t mem_address, uint8_t data)
+{
+    mStats.writes++;
+    ((mock_i2c_device_t *)dev_handle)->regs[mem_address] = data;
+    return ESP_OK;
+}
+
+esp_err_t i2c_bus_write_bits(i2c_bus_device_handle_t dev_handle, uint8_t mem_address, uint8_t bit_start, uint8_t length, uint8_t data)
+{
+    uint8_t value;
+    i2c_bus_read_byte(dev_handle, mem_address, &value);
+    uint8_t mask = ((1 << length) - 1) << (bit_start - length + 1);
+    data <<= (bit_start - length + 1);
+    value = (value & ~mask) | (data & mask);
+    return i2c_bus_write_byte(dev_handle, mem_address, value);
+}
+
+esp_err_t i2c_bus_write_bit(i2c_bus_device_handle_t dev_handle, uint8_t mem_address, uint8_t bit_num, uint8_t data)
+{
+    uint8_t value;
+    i2c_bus_read_byte(dev_handle, mem_address, &value);
+    value = data ? (value | (1 << bit_num)) : (value & ~(1 << bit_num));
+    return i2c_bus_write_byte(dev_handle, mem_address, value);
+}
+
+esp_err_t i2c_bus_read_bit(i2c_bus_device_handle_t dev_handle, uint8_t mem_address, uint8_t bit_num, uint8_t *data)
+{
+    uint8_t value;
+    i2c_bus_read_byte(dev_handle, mem_address, &value);
+    *data = (value >> bit_num) & 1;
+    return ESP_OK;
+}
+
+esp_err_t i2c_bus_read_bits(i2c_bus_device_handle_t dev_handle, uint8_t mem_address, uint8_t bit_start, uint8_t length, uint8_t *data)
+{
+    uint8_t value;
+    i2c_bus_read_byte(dev_handle, mem_address, &value);
+    uint8_t mask = ((1 << length) - 1) << (bit_start - length + 1);
+    *data = (value & mask) >> (bit_start - length + 1);
+    return ESP_OK;
+}
+
+void mock_i2c_get_stats(mock_i2c_stats_t *stats)
+{
+    *stats = mStats;
+}
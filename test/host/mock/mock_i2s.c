@@ -0,0 +1,165 @@
+#include "sim.h"
+#include "driver/i2s_std.h"
+#include <stdlib.h>
+
+struct i2s_channel_obj_t {
+    uint32_t desc_num;
+    uint32_t frame_num;
+    uint32_t sample_rate_hz;
+    uint32_t bytes_per_frame;
+    uint32_t buf_bytes;
+    bool enabled;
+
+    // Buffers the DMA sent and the writer has not taken yet, at most desc_num - 1 as in the driver
+    uint32_t free_queue;
+    // Room left in the buffer the writer currently fills
+    uint32_t write_room;
+    int64_t enable_ns;
+    uint64_t sent;          // buffers sent since enable
+
+    i2s_event_callbacks_t callbacks;
+    void *user_data;
+};
+
+static i2s_chan_handle_t mChannel = NULL;
+static mock_i2s_stats_t mStats;
+
+static void channel_update_format(i2s_chan_handle_t handle)
+{
+    handle->buf_bytes = handle->frame_num * handle->bytes_per_frame;
+}
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t *chan_cfg, i2s_chan_handle_t *ret_tx_handle, i2s_chan_handle_t *ret_rx_handle)
+{
+    if(mChannel || !ret_tx_handle || ret_rx_handle) return ESP_ERR_NOT_SUPPORTED;
+    if(chan_cfg->dma_desc_num < 2) return ESP_ERR_INVALID_ARG;
+
+    mChannel = calloc(1, sizeof(*mChannel));
+    if(!mChannel) return ESP_ERR_NO_MEM;
+    mChannel->desc_num = chan_cfg->dma_desc_num;
+    mChannel->frame_num = chan_cfg->dma_frame_num;
+    *ret_tx_handle = mChannel;
+    return ESP_OK;
+}
+
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle)
+{
+    if(handle != mChannel || handle->enabled) return ESP_ERR_INVALID_STATE;
+    free(mChannel);
+    mChannel = NULL;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t *std_cfg)
+{
+    ESP_ERROR_CHECK(i2s_channel_reconfig_std_clock(handle, &std_cfg->clk_cfg));
+    return i2s_channel_reconfig_std_slot(handle, &std_cfg->slot_cfg);
+}
+
+esp_err_t i2s_channel_reconfig_std_clock(i2s_chan_handle_t handle, const i2s_std_clk_config_t *clk_cfg)
+{
+    if(handle->enabled) return ESP_ERR_INVALID_STATE;
+    if(clk_cfg->sample_rate_hz == 0) return ESP_ERR_INVALID_ARG;
+    handle->sample_rate_hz = clk_cfg->sample_rate_hz;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_reconfig_std_slot(i2s_chan_handle_t handle, const i2s_std_slot_config_t *slot_cfg)
+{
+    if(handle->enabled) return ESP_ERR_INVALID_STATE;
+    if(slot_cfg->slot_bit_width % 8 || slot_cfg->slot_bit_width > 32) return ESP_ERR_INVALID_ARG;
+    handle->bytes_per_frame = slot_cfg->slot_mode * slot_cfg->slot_bit_width / 8;
+    channel_update_format(handle);
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle, const i2s_event_callbacks_t *callbacks, void *user_data)
+{
+    if(handle->enabled) return ESP_ERR_INVALID_STATE;
+    handle->callbacks = *callbacks;
+    handle->user_data = user_data;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle)
+{
+    if(handle->enabled) return ESP_ERR_INVALID_STATE;
+    // The DMA starts on the cleared buffers, the first one is handed out once it was sent
+    handle->enabled = true;
+    handle->free_queue = 0;
+    handle->write_room = 0;
+    handle->enable_ns = sim_now_ns();
+    handle->sent = 0;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle)
+{
+    if(!handle->enabled) return ESP_ERR_INVALID_STATE;
+    handle->enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_write(i2s_chan_handle_t handle, const void *src, size_t size, size_t *bytes_written, uint32_t timeout_ms)
+{
+    *bytes_written = 0;
+    if(!handle->enabled) return ESP_ERR_INVALID_STATE;
+
+    // The driver waits in whole ticks, pdMS_TO_TICKS() rounds down, 1 ms is no wait at 100 Hz
+    TickType_t ticks = pdMS_TO_TICKS(timeout_ms);
+    int64_t deadline = ticks == portMAX_DELAY ? INT64_MAX : sim_now_ns() + (int64_t)ticks * portTICK_PERIOD_MS * 1000000;
+    while(*bytes_written < size) {
+        if(handle->write_room == 0) {
+            if(handle->free_queue == 0) {
+                // Block until the DMA sent the next buffer
+                int64_t next = mock_i2s_next_event_ns();
+                if(next > deadline) {
+                    sim_advance_to(deadline);
+                    return ESP_ERR_TIMEOUT;
+                }
+                int64_t start = sim_now_ns();
+                sim_advance_to(next);
+                mStats.blocked_ns += sim_now_ns() - start;
+                mStats.blocked_writes++;
+                continue;
+            }
+            handle->free_queue--;
+            handle->write_room = handle->buf_bytes;
+        }
+        size_t chunk = size - *bytes_written;
+        if(chunk > handle->write_room) chunk = handle->write_room;
+        handle->write_room -= chunk;
+        *bytes_written += chunk;
+    }
+    mStats.bytes_written += *bytes_written;
+    return ESP_OK;
+}
+
+int64_t mock_i2s_next_event_ns(void)
+{
+    if(!mChannel || !mChannel->enabled) return INT64_MAX;
+    // Computed from the start so the buffer period never accumulates rounding errors
+    uint64_t frames = (mChannel->sent + 1) * mChannel->frame_num;
+    return mChannel->enable_ns + (int64_t)(frames * 1000000000ULL / mChannel->sample_rate_hz);
+}
+
+void mock_i2s_run_event(void)
+{
+    i2s_chan_handle_t handle = mChannel;
+    i2s_event_data_t event = {.data = NULL, .size = handle->buf_bytes};
+
+    handle->sent++;
+    mStats.buffers_sent++;
+    if(handle->callbacks.on_sent) handle->callbacks.on_sent(handle, &event, handle->user_data);
+    if(handle->free_queue == handle->desc_num - 1) {
+        // Nobody took the buffers, the oldest one is dropped and played again as silence
+        if(handle->callbacks.on_send_q_ovf) handle->callbacks.on_send_q_ovf(handle, &event, handle->user_data);
+    } else {
+        handle->free_queue++;
+    }
+}
+
+void mock_i2s_get_stats(mock_i2s_stats_t *stats)
+{
+    *stats = mStats;
+}
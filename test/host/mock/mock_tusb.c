@@ -0,0 +1,67 @@
+#include "sim.h"
+#include "tusb.h"
+#include "esp_private/usb_phy.h"
+#include <string.h>
+
+/**
+ * Device stack entry points used by usb.c, the simulation calls the class callbacks directly
+*/
+static const uint8_t *mRxData = NULL;
+static size_t mRxSize = 0;
+static uint8_t mControlResponse[CFG_TUD_AUDIO_FUNC_1_CTRL_BUF_SZ];
+static size_t mControlResponseSize = 0;
+
+void mock_tusb_set_rx(const void *data, size_t size)
+{
+    mRxData = data;
+    mRxSize = size;
+}
+
+size_t mock_tusb_get_control_response(void *data, size_t size)
+{
+    if(size > mControlResponseSize) size = mControlResponseSize;
+    memcpy(data, mControlResponse, size);
+    return size;
+}
+
+esp_err_t usb_new_phy(const usb_phy_config_t *config, usb_phy_handle_t *handle_ret)
+{
+    *handle_ret = NULL;
+    return ESP_OK;
+}
+
+bool tusb_init(void)
+{
+    return true;
+}
+
+void tud_task_ext(uint32_t timeout_ms, bool in_isr)
+{
+}
+
+uint16_t tud_audio_n_read(uint8_t func_id, void *buffer, uint16_t bufsize)
+{
+    uint16_t size = mRxSize < bufsize ? mRxSize : bufsize;
+    memcpy(buffer, mRxData, size);
+    mRxData += size;
+    mRxSize -= size;
+    return size;
+}
+
+bool tud_audio_buffer_and_schedule_control_xfer(uint8_t rhport, tusb_control_request_t const *p_request, void *data, uint16_t len)
+{
+    if(len > sizeof(mControlResponse)) return false;
+    memcpy(mControlResponse, data, len);
+    mControlResponseSize = len;
+    return true;
+}
+
+bool tud_hid_n_ready(uint8_t instance)
+{
+    return true;
+}
+
+bool tud_hid_n_report(uint8_t instance, uint8_t report_id, void const *report, uint16_t len)
+{
+    return true;
+}
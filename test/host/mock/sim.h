@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Simulated clock, in ns since the start of the simulation
+ *
+ * Everything runs in one thread. Time only moves in sim_advance_to(), which fires the
+ * I2S DMA events and esp_timer callbacks that fall due in order.
+*/
+int64_t sim_now_ns(void);
+void sim_advance_to(int64_t ns);
+
+/**
+ * Next I2S DMA event, INT64_MAX if the channel is not running
+*/
+int64_t mock_i2s_next_event_ns(void);
+void mock_i2s_run_event(void);
+
+typedef struct mock_i2s_stats {
+    uint64_t bytes_written;
+    uint64_t buffers_sent;
+    uint64_t blocked_ns;        // simulated time the writer waited for a free DMA buffer
+    uint32_t blocked_writes;
+} mock_i2s_stats_t;
+
+void mock_i2s_get_stats(mock_i2s_stats_t *stats);
+
+typedef struct mock_i2c_stats {
+    uint32_t writes;
+    uint32_t reads;
+} mock_i2c_stats_t;
+
+void mock_i2c_get_stats(mock_i2c_stats_t *stats);
+
+/**
+ * @brief Data returned by the next tud_audio_read() calls
+*/
+void mock_tusb_set_rx(const void *data, size_t size);
+
+/**
+ * @brief Response of the last control request answered with tud_audio_buffer_and_schedule_control_xfer()
+*/
+size_t mock_tusb_get_control_response(void *data, size_t size);
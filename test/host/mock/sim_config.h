@@ -0,0 +1,35 @@
+#pragma once
+
+/**
+ * Overrides applied on top of the generated sdkconfig.h
+ *
+ * Features that need the real RTOS, power management, the LED or more USB interfaces than the
+ * mocks provide are turned off. The latency measurement, profiling, verification and
+ * the test signal generator are always on since they only need the clock.
+*/
+#undef CONFIG_AUDIO_STATS
+#undef CONFIG_AUDIO_TRACE
+#undef CONFIG_AUDIO_CONSOLE
+#undef CONFIG_AUDIO_PCM_BENCHMARK
+#undef CONFIG_AUDIO_PM
+#undef CONFIG_AUDIO_LED_METER
+
+#undef CONFIG_AUDIO_LATENCY
+#define CONFIG_AUDIO_LATENCY 1
+
+#undef CONFIG_AUDIO_PROFILE
+#define CONFIG_AUDIO_PROFILE 1
+
+#undef CONFIG_AUDIO_VERIFY
+#define CONFIG_AUDIO_VERIFY 1
+
+// The generator is driven by the simulation, never started at boot
+#undef CONFIG_AUDIO_SIGGEN_BOOT_SINE
+#undef CONFIG_AUDIO_SIGGEN_BOOT_SWEEP
+#undef CONFIG_AUDIO_SIGGEN_BOOT_NOISE
+#ifndef CONFIG_AUDIO_SIGGEN
+#define CONFIG_AUDIO_SIGGEN 1
+#define CONFIG_AUDIO_SIGGEN_SINE_HZ 997
+#define CONFIG_AUDIO_SIGGEN_LEVEL_DBFS -1
+#define CONFIG_AUDIO_SIGGEN_SWEEP_MS 10000
+#endif
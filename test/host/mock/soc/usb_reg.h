@@ -0,0 +1,4 @@
+#pragma once
+
+#define USB_SOF_M       (1 << 3)
+#define USB_RXFLVI_M    (1 << 4)
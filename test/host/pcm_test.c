@@ -0,0 +1,143 @@
+#include "pcm.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Level meter of the conversion kernels against a known tone
+//
+// The left channel carries PCM_TEST_LEFT_DBFS, the right PCM_TEST_RIGHT_DBFS. Over whole
+// periods the energy per sample is A^2 / 2 and the peak is A, in 16 bit units.
+
+#define PCM_TEST_RATE           48000
+#define PCM_TEST_TONE_HZ        997.0
+#define PCM_TEST_LEFT_DBFS      -6.0
+#define PCM_TEST_RIGHT_DBFS     -20.0
+#define PCM_TEST_FRAMES         PCM_TEST_RATE   // one second, 997 whole periods
+#define PCM_TEST_CHUNK          97              // odd, so the 24 bit kernel runs its tail
+#define PCM_TEST_GAIN_DB        -12.f           // the meter reads the samples before the gain
+
+static int mFailed = 0;
+
+#define CHECK(cond, ...) do { \
+    if(!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        mFailed++; \
+    } \
+} while(0)
+
+static double pcm_test_amplitude(double dbfs, int bits)
+{
+    return pow(10.0, dbfs / 20.0) * ((1 << (bits - 1)) - 1);
+}
+
+/**
+ * @brief Tone left-justified to 32 bits at the given resolution
+*/
+static void pcm_test_tone(int32_t *samples, size_t frames, int bits)
+{
+    const double amplitude[PCM_CHANNELS] = {
+        pcm_test_amplitude(PCM_TEST_LEFT_DBFS, bits),
+        pcm_test_amplitude(PCM_TEST_RIGHT_DBFS, bits),
+    };
+    for(size_t n = 0; n < frames; n++) {
+        double phase = 2 * M_PI * PCM_TEST_TONE_HZ * n / PCM_TEST_RATE;
+        for(int ch = 0; ch < PCM_CHANNELS; ch++) {
+            samples[n * PCM_CHANNELS + ch] = (int32_t)lround(amplitude[ch] * sin(phase)) * (1 << (32 - bits));
+        }
+    }
+}
+
+static void pcm_test_check(const char *name, const pcm_meter_t *meter)
+{
+    double left = pcm_test_amplitude(PCM_TEST_LEFT_DBFS, 16);
+    double right = pcm_test_amplitude(PCM_TEST_RIGHT_DBFS, 16);
+    double peak = meter->peak / 65536.0;
+    double energy = (double)meter->energy / meter->samples;
+    double expected = (left * left + right * right) / 4;
+
+    printf("%-8s peak %.1f (expected %.1f), energy %.4g (expected %.4g) per sample, %u samples\n",
+           name, peak, left, energy, expected, meter->samples);
+    CHECK(meter->samples == PCM_TEST_FRAMES * PCM_CHANNELS, "%s: %u samples", name, meter->samples);
+    CHECK(fabs(peak - left) <= 1, "%s: peak %.1f, expected %.1f", name, peak, left);
+    CHECK(fabs(energy - expected) <= expected * 0.005, "%s: energy %.4g, expected %.4g", name, energy, expected);
+}
+
+/**
+ * @brief Run one kernel over the tone in chunks, with a meter and without
+ *
+ * The output must not depend on the meter, the meter must not depend on the gain.
+*/
+static void pcm_test_kernel(const char *name, int bits, size_t sample_bytes,
+                            size_t (*convert)(pcm_gain_t *, pcm_meter_t *, void *, size_t))
+{
+    size_t size = PCM_TEST_FRAMES * PCM_CHANNELS * sizeof(int32_t);
+    int32_t *tone = malloc(size);
+    uint8_t *metered = malloc(size);
+    uint8_t *plain = malloc(size);
+    pcm_test_tone(tone, PCM_TEST_FRAMES, bits);
+
+    int32_t gain_db = pcm_gain_from_db(PCM_TEST_GAIN_DB);
+    for(int unity = 1; unity >= 0; unity--) {
+        pcm_gain_t gain[2];
+        pcm_gain_init(&gain[0], unity ? PCM_GAIN_UNITY : gain_db, PCM_RAMP_LINEAR);
+        gain[1] = gain[0];
+        pcm_meter_t meter;
+        pcm_meter_reset(&meter);
+
+        // The kernels convert in place, every chunk starts from a copy of the tone
+        size_t in_bytes = PCM_CHANNELS * (bits == 16 ? 2 : 4), out_bytes = PCM_CHANNELS * sample_bytes;
+        size_t out = 0;
+        for(size_t frame = 0; frame < PCM_TEST_FRAMES; frame += PCM_TEST_CHUNK) {
+            size_t frames = PCM_TEST_FRAMES - frame < PCM_TEST_CHUNK ? PCM_TEST_FRAMES - frame : PCM_TEST_CHUNK;
+            uint8_t chunk[2][PCM_TEST_CHUNK * PCM_CHANNELS * sizeof(int32_t)];
+            for(int i = 0; i < 2; i++) {
+                if(bits == 16) {
+                    int16_t *s16 = (int16_t *)chunk[i];
+                    for(size_t n = 0; n < frames * PCM_CHANNELS; n++) s16[n] = tone[frame * PCM_CHANNELS + n] >> 16;
+                } else {
+                    memcpy(chunk[i], &tone[frame * PCM_CHANNELS], frames * in_bytes);
+                }
+            }
+            size_t converted = convert(&gain[0], &meter, chunk[0], frames);
+            CHECK(converted == frames * out_bytes, "%s: converted %zu bytes", name, converted);
+            CHECK(convert(&gain[1], NULL, chunk[1], frames) == converted, "%s: size depends on the meter", name);
+            memcpy(metered + out, chunk[0], converted);
+            memcpy(plain + out, chunk[1], converted);
+            out += converted;
+        }
+
+        CHECK(memcmp(metered, plain, out) == 0, "%s: output depends on the meter", name);
+        pcm_test_check(name, &meter);
+    }
+
+    free(tone);
+    free(metered);
+    free(plain);
+}
+
+static size_t pcm_test_convert_s16(pcm_gain_t *gain, pcm_meter_t *meter, void *data, size_t frames)
+{
+    return pcm_convert_s16(gain, meter, data, frames);
+}
+
+static size_t pcm_test_convert_s32(pcm_gain_t *gain, pcm_meter_t *meter, void *data, size_t frames)
+{
+    return pcm_convert_s32(gain, meter, data, frames);
+}
+
+int main(void)
+{
+    pcm_test_kernel("s16", 16, 2, pcm_test_convert_s16);
+    pcm_test_kernel("s32", 24, 4, pcm_test_convert_s32);
+    pcm_test_kernel("s32>s24", 24, 3, pcm_convert_s32_to_s24);
+
+    if(mFailed) {
+        printf("%d checks failed\n", mFailed);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""
+IRAM placement report from the linker map (CONFIG_AUDIO_IRAM).
+
+    iram_report.py build/s3-speakers.map                list IRAM use per archive and object
+    iram_report.py build/s3-speakers.map --symbols      also list every input section
+    iram_report.py build/s3-speakers.map --check        fail unless every main/linker.lf entry is in IRAM
+
+Entries of main/linker.lf with no section of their own, inlined into their caller
+or compiled out by the configuration, are reported as absent. Only entries found
+outside IRAM fail the check.
+"""
+
+import argparse
+import os
+import re
+import sys
+from collections import defaultdict
+
+LINKER_LF = os.path.join(os.path.dirname(__file__), "..", "main", "linker.lf")
+
+# " .text.audio_write  0x40378abc  0x54 esp-idf/main/libmain.a(audio.c.obj)", the name may be on its own line
+INPUT_SECTION = re.compile(r"^ (\.\S+|COMMON)(?:\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S.*))?$")
+ADDRESS_SIZE = re.compile(r"^\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S.*)$")
+OBJECT = re.compile(r"(?:.*/)?(lib[^/(]+\.a)\(([^)]+?)(?:\.c)?\.obj\)")
+
+
+def parse_map(path):
+    """Input sections of every output section: (output, section, size, archive, object)."""
+    sections = []
+    output = None
+    pending = None
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if line and not line[0].isspace():
+                output = line.split()[0]
+                pending = None
+                continue
+            if output is None:
+                continue
+
+            if pending:
+                m = ADDRESS_SIZE.match(line)
+                name, pending = pending, None
+                if m:
+                    sections.append((output,) + section_entry(name, m.group(2), m.group(3)))
+                continue
+
+            m = INPUT_SECTION.match(line)
+            if not m:
+                continue
+            if m.group(2) is None:
+                pending = m.group(1)
+            else:
+                sections.append((output,) + section_entry(m.group(1), m.group(3), m.group(4)))
+    return [s for s in sections if s[2] > 0]
+
+
+def section_entry(name, size, source):
+    m = OBJECT.match(source)
+    archive, obj = (m.group(1), m.group(2)) if m else ("", source)
+    return name, int(size, 16), archive, obj
+
+
+def linker_lf_entries(path):
+    """(archive, object, symbol) of every mapping entry, symbol None for a whole object."""
+    entries = []
+    archive = None
+    with open(path) as f:
+        for line in f:
+            line = line.split("#")[0].strip()
+            if line.startswith("archive:"):
+                archive = line.split(":", 1)[1].strip()
+            elif line.endswith("(noflash)") and archive:
+                target = line[: -len("(noflash)")].strip()
+                obj, _, symbol = target.partition(":")
+                entries.append((archive, obj, symbol or None))
+    return entries
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("map", help="linker map of the firmware, build/<project>.map")
+    parser.add_argument("--symbols", action="store_true", help="list every input section")
+    parser.add_argument("--check", action="store_true", help="check the entries of main/linker.lf")
+    parser.add_argument("--linker-lf", default=LINKER_LF, help="linker fragment to check")
+    args = parser.parse_args()
+
+    placed = parse_map(args.map)
+    sections = [s[1:] for s in placed if s[0].startswith(".iram0")]
+    per_archive = defaultdict(int)
+    per_object = defaultdict(int)
+    for name, size, archive, obj in sections:
+        per_archive[archive] += size
+        per_object[(archive, obj)] += size
+
+    total = sum(per_archive.values())
+    print(f"IRAM {total} bytes in {len(sections)} sections")
+    for archive, size in sorted(per_archive.items(), key=lambda a: -a[1]):
+        print(f"  {size:8} {archive or '(linker)'}")
+        for (a, obj), obj_size in sorted(per_object.items(), key=lambda o: -o[1]):
+            if a == archive and a:
+                print(f"  {obj_size:8}     {obj}")
+
+    if args.symbols:
+        print()
+        for name, size, archive, obj in sorted(sections, key=lambda s: (s[2], s[3], s[0])):
+            print(f"  {size:8} {archive}({obj}) {name}")
+
+    if not args.check:
+        return 0
+
+    missing = 0
+    print()
+    for archive, obj, symbol in linker_lf_entries(args.linker_lf):
+        found = [s for s in placed if s[3] == archive and s[4] == obj and (symbol is None or s[1].endswith("." + symbol))]
+        if symbol is None:
+            # Whole objects, anything executable outside IRAM counts
+            found = [s for s in found if s[1].startswith((".text", ".literal", ".iram1"))]
+        if not found:
+            state = "absent"
+        elif all(s[0].startswith(".iram0") for s in found):
+            state = "ok"
+        else:
+            state = "MISSING"
+        missing += state == "MISSING"
+        print(f"  {state:8} {archive}({obj}){':' + symbol if symbol else ''}")
+    if missing:
+        print(f"{missing} entries not in IRAM, is CONFIG_AUDIO_IRAM enabled?", file=sys.stderr)
+    return 1 if missing else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""
+Internal RAM budget from the linker map (CONFIG_AUDIO_RAM_BUDGET_KB).
+
+    mem_budget.py build/s3_audio.map                    static DRAM per subsystem and object
+    mem_budget.py build/s3_audio.map --budget 128       fail when the application exceeds 128 KB
+
+Task stacks, queues, rings and packet buffers are static, they show up in .dram0.bss
+of their object. The I2S DMA buffers are the only audio memory the driver allocates,
+counted here at their largest, AUDIO_DMA_DESC_NUM_MAX buffers of 4092 bytes. ESP-IDF
+is reported but does not count against the budget.
+"""
+
+import argparse
+import os
+import re
+import sys
+from collections import defaultdict
+
+from iram_report import parse_map
+
+AUDIO_H = os.path.join(os.path.dirname(__file__), "..", "main", "include", "audio.h")
+
+# I2S DMA buffer limit and the lldesc_t of each buffer
+DMA_BUFFER_MAX = 4092
+DMA_DESC_SIZE = 12
+
+# Objects of main by subsystem, components by archive
+SUBSYSTEMS = {
+    "audio": ("audio", "pcm", "latency", "verify", "siggen", "profile"),
+    "usb": ("usb", "usb_descriptors"),
+    "control": ("main", "reactor", "events", "led", "touchsensor", "settings", "power"),
+    "diagnostics": ("trace", "stats", "console"),
+}
+ARCHIVES = {
+    "libespressif__tinyusb.a": "usb",
+    "libbus.a": "drivers",
+    "libes8156.a": "drivers",
+}
+
+# "dram0_0_seg      0x3fc88000         0x00055700         rw"
+MEMORY_REGION = re.compile(r"^(\w+)\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)")
+
+
+def subsystem(archive, obj):
+    if archive == "libmain.a":
+        for name, objects in SUBSYSTEMS.items():
+            if obj in objects:
+                return name
+        return "control"
+    return ARCHIVES.get(archive, "esp-idf")
+
+
+def dram_size(path):
+    """Length of dram0_0_seg from the Memory Configuration of the map."""
+    with open(path) as f:
+        for line in f:
+            m = MEMORY_REGION.match(line)
+            if m and m.group(1) == "dram0_0_seg":
+                return int(m.group(3), 16)
+    return None
+
+
+def dma_desc_num_max(path):
+    with open(path) as f:
+        m = re.search(r"#define\s+AUDIO_DMA_DESC_NUM_MAX\s+(\d+)", f.read())
+    return int(m.group(1)) if m else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("map", help="linker map of the firmware, build/<project>.map")
+    parser.add_argument("--budget", type=int, help="application budget in KB, fail when exceeded")
+    parser.add_argument("--audio-h", default=AUDIO_H, help="header defining AUDIO_DMA_DESC_NUM_MAX")
+    args = parser.parse_args()
+
+    per_subsystem = defaultdict(int)
+    per_object = defaultdict(int)
+    for output, name, size, archive, obj in parse_map(args.map):
+        if not output.startswith(".dram0"):
+            continue
+        per_subsystem[subsystem(archive, obj)] += size
+        per_object[(subsystem(archive, obj), archive, obj)] += size
+
+    dma = dma_desc_num_max(args.audio_h) * (DMA_BUFFER_MAX + DMA_DESC_SIZE)
+    per_subsystem["audio"] += dma
+
+    application = sum(size for name, size in per_subsystem.items() if name != "esp-idf")
+    print(f"Internal RAM {application} bytes for the application, I2S DMA at most {dma} bytes included")
+    for name, size in sorted(per_subsystem.items(), key=lambda s: -s[1]):
+        print(f"  {size:8} {name}")
+        if name == "audio" and dma:
+            print(f"  {dma:8}     I2S DMA buffers, heap")
+        if name == "esp-idf":
+            continue
+        for (s, archive, obj), obj_size in sorted(per_object.items(), key=lambda o: -o[1]):
+            if s == name:
+                print(f"  {obj_size:8}     {archive}({obj})")
+
+    dram = dram_size(args.map)
+    if dram:
+        static = sum(per_object.values())
+        print(f"DRAM {static} of {dram} bytes static, {dram - static} left for the heap")
+
+    if args.budget is None:
+        return 0
+    budget = args.budget * 1024
+    if application > budget:
+        print(f"Application internal RAM {application} bytes exceeds the budget of {budget} bytes, "
+              f"see CONFIG_AUDIO_RAM_BUDGET_KB", file=sys.stderr)
+        return 1
+    print(f"Within the budget of {budget} bytes, {budget - application} left")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
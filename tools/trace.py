@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""
+Dump and decode the binary event trace of the speaker firmware (CONFIG_AUDIO_TRACE).
+
+    trace.py dump trace.bin             read the trace buffer over the vendor interface (needs pyusb)
+    trace.py decode trace.bin -o x.json convert a dump to Chrome trace JSON, open in ui.perfetto.dev
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+
+HEADER = struct.Struct("<4sBBHII")
+RECORD = struct.Struct("<IBBHII")
+MAGIC = b"S3TR"
+VERSION = 1
+
+CMD_DUMP = b"d"
+VID = 0x303A
+
+TRACE_H = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "main", "include", "trace.h")
+
+
+def load_events(path):
+    """Parse the TRACE_EVENTS list, ids follow the order of the entries."""
+    with open(path) as f:
+        source = f.read()
+    pattern = re.compile(r'X\(\s*(\w+)\s*,\s*(\w+)\s*,\s*"([^"]*)"\s*,\s*"([^"]*)"\s*\)')
+    events = [m.groups() for m in pattern.finditer(source)]
+    if not events:
+        sys.exit(f"no trace events found in {path}")
+    return events
+
+
+def dump(args):
+    import usb.core
+    import usb.util
+
+    dev = usb.core.find(idVendor=VID, custom_match=lambda d: any(
+        i.bInterfaceClass == 0xFF for cfg in d for i in cfg))
+    if dev is None:
+        sys.exit("device with trace interface not found")
+
+    itf = next(i for i in dev.get_active_configuration() if i.bInterfaceClass == 0xFF)
+    ep_out = usb.util.find_descriptor(itf, custom_match=lambda e: usb.util.endpoint_direction(e.bEndpointAddress) == usb.util.ENDPOINT_OUT)
+    ep_in = usb.util.find_descriptor(itf, custom_match=lambda e: usb.util.endpoint_direction(e.bEndpointAddress) == usb.util.ENDPOINT_IN)
+    usb.util.claim_interface(dev, itf)
+
+    # The header and the first records share a packet, reads must take whole packets
+    chunk = 64 * ep_in.wMaxPacketSize
+    ep_out.write(CMD_DUMP)
+    data = b""
+    while len(data) < HEADER.size:
+        data += bytes(ep_in.read(chunk, timeout=1000))
+    magic, version, record_size, _, count, lost = HEADER.unpack_from(data)
+    if magic != MAGIC:
+        sys.exit(f"unexpected dump header {data[:HEADER.size]!r}")
+    size = HEADER.size + count * record_size
+    while len(data) < size:
+        data += bytes(ep_in.read(chunk, timeout=1000))
+    data = data[:size]
+
+    usb.util.release_interface(dev, itf)
+    with open(args.file, "wb") as f:
+        f.write(data)
+    print(f"{count} records, {lost} lost", file=sys.stderr)
+
+
+def decode(args):
+    events = load_events(args.header)
+    with open(args.file, "rb") as f:
+        data = f.read()
+
+    magic, version, record_size, cpu_mhz, count, lost = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+        sys.exit(f"unsupported dump: magic {magic!r} version {version} record size {record_size}")
+
+    trace = []
+    base, last, wraps, torn = None, None, 0, 0
+    for offset in range(HEADER.size, HEADER.size + count * record_size, record_size):
+        timestamp, event, core, seq, arg0, arg1 = RECORD.unpack_from(data, offset)
+        if event == 0 or event >= len(events):
+            torn += 1
+            continue
+
+        # Timestamps are 32 bit us, unwrap and start at zero
+        if last is not None and timestamp < last and last - timestamp > 1 << 31:
+            wraps += 1
+        last = timestamp
+        ts = timestamp + (wraps << 32)
+        if base is None:
+            base = ts
+
+        name, kind, arg0_name, arg1_name = events[event]
+        entry = {"name": name.lower(), "pid": 0, "tid": core, "ts": ts - base, "args": {}}
+        if arg0_name:
+            entry["args"][arg0_name] = arg0
+        if arg1_name:
+            entry["args"][arg1_name] = arg1
+
+        if kind in ("BEGIN", "END"):
+            # WRITE_BEGIN and WRITE_END form one slice named write
+            entry.update(ph=kind[0], name=name.lower().rsplit("_", 1)[0])
+        elif kind == "COMPLETE":
+            # Second argument is the duration in CPU cycles, the record marks the end
+            dur = arg1 / cpu_mhz
+            entry.update(ph="X", dur=dur, ts=entry["ts"] - dur)
+        else:
+            entry.update(ph="i", s="t")
+        trace.append(entry)
+
+    trace += [{"name": "thread_name", "ph": "M", "pid": 0, "tid": core, "args": {"name": f"core {core}"}} for core in (0, 1)]
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    json.dump({"traceEvents": trace, "displayTimeUnit": "ns",
+               "otherData": {"lost": lost, "torn": torn, "cpu_mhz": cpu_mhz}}, out)
+    print(f"{len(trace) - 2} events, {lost} lost, {torn} torn", file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("dump", help="read the trace buffer from the device")
+    p.add_argument("file")
+    p.set_defaults(func=dump)
+
+    p = sub.add_parser("decode", help="convert a dump to Chrome trace JSON")
+    p.add_argument("file")
+    p.add_argument("-o", "--output", help="output file, stdout if omitted")
+    p.add_argument("--header", default=TRACE_H, help="trace.h holding the event list")
+    p.set_defaults(func=decode)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""
+Bit-perfect verification of the speaker firmware (CONFIG_AUDIO_VERIFY).
+
+    verify.py wav pattern.wav -r 96000 -b 24    write the pattern, play it with any bit-perfect player
+    verify.py play -r 96000 -b 24 -s 600        stream the pattern (needs sounddevice), then check
+    verify.py check                             compare the device's counters and CRC with the pattern (needs hidapi)
+
+The left sample of frame n is n, wrapping at the bit depth, the right sample is a
+check value derived from it, see verify.h. Set the host volume to the maximum so
+the firmware's gain is unity, and disable any resampling or mixing on the host.
+"""
+
+import argparse
+import struct
+import sys
+import wave
+import zlib
+
+VID = 0x303A
+REPORT_ID_VERIFY = 4
+REPORT = struct.Struct("<BBHIIIIII")
+REPORT_VERSION = 1
+
+# Silence around the pattern covers the gain ramp and the host opening the stream
+LEAD_IN_S = 0.5
+CHUNK_FRAMES = 4800
+
+
+def pattern_check(counter, bits):
+    """verify_pattern_check() from verify.h."""
+    check = (((counter ^ 0x5A5A5A5A) * 0x9E3779B1) & 0xFFFFFFFF) >> (32 - bits)
+    return check or 1
+
+
+def pattern(first, frames, bits):
+    """Frames of the pattern as packed little endian PCM, the layout the firmware checksums."""
+    mask = (1 << bits) - 1
+    width = bits // 8
+    out = bytearray()
+    for n in range(first, first + frames):
+        left = n & mask
+        out += left.to_bytes(width, "little") + pattern_check(left, bits).to_bytes(width, "little")
+    return bytes(out)
+
+
+def chunks(rate, bits, seconds):
+    """The stream to play: lead-in silence, the pattern, trailing silence."""
+    silence = bytes(int(rate * LEAD_IN_S) * 2 * bits // 8)
+    yield silence
+    total = int(rate * seconds)
+    for first in range(0, total, CHUNK_FRAMES):
+        yield pattern(first, min(CHUNK_FRAMES, total - first), bits)
+    yield silence
+
+
+def write_wav(args):
+    with wave.open(args.file, "wb") as w:
+        w.setnchannels(2)
+        w.setsampwidth(args.bits // 8)
+        w.setframerate(args.rate)
+        for data in chunks(args.rate, args.bits, args.seconds):
+            w.writeframes(data)
+    print(f"{args.file}: {args.seconds} s of pattern at {args.rate} Hz {args.bits} bit", file=sys.stderr)
+
+
+def play(args):
+    import sounddevice
+
+    dtype = {16: "int16", 24: "int24"}[args.bits]
+    with sounddevice.RawOutputStream(samplerate=args.rate, channels=2, dtype=dtype, device=args.device) as stream:
+        for data in chunks(args.rate, args.bits, args.seconds):
+            stream.write(data)
+    return check(args)
+
+
+def read_report():
+    import hid
+
+    for info in hid.enumerate(VID):
+        dev = hid.device()
+        try:
+            dev.open_path(info["path"])
+            data = bytes(dev.get_feature_report(REPORT_ID_VERIFY, 64))
+        except (IOError, ValueError):
+            continue
+        finally:
+            dev.close()
+        # Some platforms return the report id as the first byte
+        if len(data) > REPORT.size and data[0] == REPORT_ID_VERIFY:
+            data = data[1:]
+        if len(data) >= REPORT.size:
+            return data
+    sys.exit("device with verify report not found")
+
+
+def check(args):
+    version, length, _, first, frames, crc, dropped, duplicated, corrupted = REPORT.unpack_from(read_report())
+    if version != REPORT_VERSION or length < REPORT.size:
+        sys.exit("firmware built without CONFIG_AUDIO_VERIFY")
+
+    print(f"{frames} frames from {first}, crc {crc:08x}, {dropped} dropped, {duplicated} duplicated, {corrupted} corrupted")
+    if frames == 0:
+        sys.exit("no pattern received, is the host volume at maximum?")
+
+    # The counter wraps at the bit depth, the device only knows the first counter modulo it
+    expected = 0
+    for start in range(first, first + frames, CHUNK_FRAMES):
+        expected = zlib.crc32(pattern(start, min(CHUNK_FRAMES, first + frames - start), args.bits), expected)
+    if dropped or duplicated or corrupted:
+        print("not bit-perfect, the CRC cannot match")
+        return 1
+    if crc != expected:
+        print(f"CRC mismatch, expected {expected:08x}: wrong bit depth, or altered samples that still look like the pattern")
+        return 1
+    print("bit-perfect")
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    def stream_args(p):
+        p.add_argument("-r", "--rate", type=int, default=48000, choices=(44100, 48000, 88200, 96000))
+        p.add_argument("-b", "--bits", type=int, default=24, choices=(16, 24))
+
+    p = sub.add_parser("wav", help="write the pattern to a WAV file")
+    p.add_argument("file")
+    stream_args(p)
+    p.add_argument("-s", "--seconds", type=float, default=60)
+    p.set_defaults(func=write_wav)
+
+    p = sub.add_parser("play", help="stream the pattern to the device and check it")
+    stream_args(p)
+    p.add_argument("-s", "--seconds", type=float, default=60)
+    p.add_argument("-d", "--device", help="sounddevice output device, name or index")
+    p.set_defaults(func=play)
+
+    p = sub.add_parser("check", help="check the last stream against the pattern")
+    stream_args(p)
+    p.set_defaults(func=check)
+
+    args = parser.parse_args()
+    sys.exit(args.func(args))
+
+
+if __name__ == "__main__":
+    main()